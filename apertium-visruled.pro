@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui xml widgets
+QT       += core gui xml widgets concurrent
 
 TARGET = apertium-visruled
 TEMPLATE = app
@@ -25,7 +25,19 @@ SOURCES += src/main.cpp\
     src/sidebar.cpp \
     src/settingsdialog.cpp \
     src/tools.cpp \
-    src/testdialog.cpp
+    src/testdialog.cpp \
+    src/scenediagram.cpp \
+    src/scenelayout.cpp \
+    src/symbolstrip.cpp \
+    src/journal.cpp \
+    src/corpus.cpp \
+    src/profiler.cpp \
+    src/profiledialog.cpp \
+    src/interpreter.cpp \
+    src/patternindex.cpp \
+    src/patternanalyzer.cpp \
+    src/patterndialog.cpp \
+    src/patterns.cpp
 
 HEADERS  += src/mainwindow.h \
     src/node.h \
@@ -41,14 +53,28 @@ HEADERS  += src/mainwindow.h \
     src/sidebar.h \
     src/settingsdialog.h \
     src/tools.h \
-    src/testdialog.h
+    src/testdialog.h \
+    src/scenediagram.h \
+    src/scenelayout.h \
+    src/symbolstrip.h \
+    src/journal.h \
+    src/corpus.h \
+    src/profiler.h \
+    src/profiledialog.h \
+    src/interpreter.h \
+    src/patternindex.h \
+    src/patternanalyzer.h \
+    src/patterndialog.h \
+    src/patterns.h
 
 FORMS    += src/mainwindow.ui \
     src/filetab.ui \
     src/sectiontab.ui \
     src/newfiledialog.ui \
     src/settingsdialog.ui \
-    src/testdialog.ui
+    src/testdialog.ui \
+    src/profiledialog.ui \
+    src/patterndialog.ui
 
 OTHER_FILES += \
     res/schema.xml \
@@ -73,6 +99,10 @@ unix {
     QMAKE_CXXFLAGS += -DVISRULED_DATADIR=$$data.path
 }
 
+profile {
+    DEFINES += VISRULED_PROFILE
+}
+
 win32 {
     QMAKE_CXXFLAGS += -DVISRULED_DATADIR="../apertium-visruled"
 }
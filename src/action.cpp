@@ -19,11 +19,93 @@
 
 #include "action.h"
 #include "diagram.h"
+#include "config.h"
+#include <QSet>
+#include <QDebug>
+
+CompoundAction::~CompoundAction()
+{
+    qDeleteAll(actions_);
+}
+
+void CompoundAction::add(Action *a)
+{
+    actions_.append(a);
+    a->record(ops_);
+    recorded_ = true;
+}
+
+void CompoundAction::execute()
+{
+    foreach (Action* a, actions_) {
+        a->execute();
+        if (!recorded_) {
+            a->record(ops_);
+        }
+    }
+    recorded_ = true;
+}
+
+void CompoundAction::undo()
+{
+    for (int i = actions_.size() - 1; i >= 0; i--) {
+        actions_[i]->undo();
+    }
+}
+
+Node* CompoundAction::target() const
+{
+    Node* res = NULL;
+    for (int i = 0; i<actions_.size(); i++) {
+        Node* t = actions_[i]->target();
+        if (t == NULL) {
+            return NULL;
+        } else if (i == 0) {
+            res = t;
+            continue;
+        }
+
+        // the nearest node having both as descendants
+        QSet<Node*> ancestors;
+        for (Node* n = res; n != NULL; n = n->parentNode()) {
+            ancestors.insert(n);
+        }
+        while (t != NULL && !ancestors.contains(t)) {
+            t = t->parentNode();
+        }
+        if (t == NULL) {
+            return NULL;
+        }
+        res = t;
+    }
+
+    return res;
+}
+
+qint64 CompoundAction::cost() const
+{
+    qint64 res = sizeof(*this);
+    foreach (Action* a, actions_) {
+        res += a->cost();
+    }
+
+    return res;
+}
 
 ActionStack::ActionStack(QObject *parent)
     : QObject(parent)
     , undoStack_()
     , redoStack_()
+    , transactions_()
+    , undoSteps_()
+    , redoSteps_()
+    , pagedSteps_()
+    , journal_(NULL)
+    , root_(NULL)
+    , diagram_(NULL)
+    , undoCost_(0)
+    , lastPush_()
+    , canMerge_(false)
 {}
 
 ActionStack::~ActionStack()
@@ -35,39 +117,248 @@ ActionStack::~ActionStack()
     foreach (Action* a, redoStack_) {
         delete a;
     }
+
+    qDeleteAll(transactions_);
 }
 
 void ActionStack::push(Action *a)
 {
-    foreach (Action* a, redoStack_) {
-        delete a;
+    if (!transactions_.isEmpty()) {
+        a->execute();
+        transactions_.top()->add(a);
+        return;
     }
-    redoStack_.clear();
 
-    undoStack_.push(a);
+    clearRedo();
     a->execute();
-    emit actionPerformed();
+
+    QList<journal::Op> ops;
+    a->record(ops);
+    QList<qint64> steps = writeStep(ops);
+
+    // consecutive edits of the same thing within a short time, like typing
+    // into a property, become one undo step
+    Action* top = undoStack_.isEmpty() ? NULL : undoStack_.top();
+    bool recent = lastPush_.isValid() && lastPush_.elapsed() <= appConfig().undoMergeInterval();
+    qint64 topCost = top == NULL ? 0 : top->cost();
+    if (canMerge_ && recent && top != NULL && top->mergeWith(a)) {
+        undoCost_ += top->cost() - topCost;
+        undoSteps_.top() += steps;
+        delete a;
+    } else {
+        undoStack_.push(a);
+        undoSteps_.push(steps);
+        undoCost_ += a->cost();
+    }
+
+    canMerge_ = true;
+    lastPush_.start();
+    trim();
+    performed(undoStack_.top());
 }
 
 void ActionStack::undo()
 {
+    if (undoStack_.isEmpty()) {
+        pageIn();
+    }
+
     Action* a = undoStack_.pop();
+    QList<qint64> steps = undoSteps_.pop();
+    undoCost_ -= a->cost();
     a->undo();
+    if (journal_ != NULL) {
+        for (int i = steps.size() - 1; i >= 0; i--) {
+            journal_->writeUndo(steps[i]);
+        }
+    }
+
     redoStack_.push(a);
-    emit actionPerformed();
+    redoSteps_.push(steps);
+    canMerge_ = false;
+    performed(a);
 }
 
 void ActionStack::redo()
 {
     Action* a = redoStack_.pop();
+    QList<qint64> steps = redoSteps_.pop();
     a->execute();
+    if (journal_ != NULL) {
+        foreach (qint64 step, steps) {
+            journal_->writeRedo(step);
+        }
+    }
+
     undoStack_.push(a);
+    undoSteps_.push(steps);
+    undoCost_ += a->cost();
+    canMerge_ = false;
+    trim();
+    performed(a);
+}
+
+void ActionStack::beginTransaction()
+{
+    transactions_.push(new CompoundAction);
+    if (transactions_.size() == 1) {
+        emit transactionStarted();
+    }
+}
+
+void ActionStack::commitTransaction()
+{
+    if (transactions_.isEmpty()) {
+        qWarning() << "ActionStack::commitTransaction without a transaction";
+        return;
+    }
+
+    CompoundAction* t = transactions_.pop();
+    if (!transactions_.isEmpty()) {
+        if (t->isEmpty()) {
+            delete t;
+        } else {
+            transactions_.top()->add(t);
+        }
+        return;
+    }
+
+    emit transactionFinished();
+    if (t->isEmpty()) {
+        delete t;
+        return;
+    }
+
+    // the actions of the transaction are already executed
+    clearRedo();
+    QList<journal::Op> ops;
+    t->record(ops);
+    undoSteps_.push(writeStep(ops));
+    undoStack_.push(t);
+    undoCost_ += t->cost();
+    canMerge_ = false;
+    trim();
+    performed(t);
+}
+
+void ActionStack::rollbackTransaction()
+{
+    if (transactions_.isEmpty()) {
+        qWarning() << "ActionStack::rollbackTransaction without a transaction";
+        return;
+    }
+
+    CompoundAction* t = transactions_.pop();
+    t->undo();
+
+    // the views have seen none of the actions, nor their undoing; a rolled
+    // back nested transaction is reported by the outermost one
+    if (transactions_.isEmpty()) {
+        emit transactionFinished();
+        performed(t);
+    }
+    delete t;
+}
+
+void ActionStack::performed(Action *a)
+{
+    emit nodeChanged(a->target());
     emit actionPerformed();
 }
 
+void ActionStack::clearRedo()
+{
+    foreach (Action* a, redoStack_) {
+        delete a;
+    }
+    redoStack_.clear();
+    redoSteps_.clear();
+}
+
+void ActionStack::trim()
+{
+    // drop the oldest entries, the last one is always kept
+    const int maxEntries = appConfig().undoLimit();
+    const qint64 maxCost = appConfig().undoMemoryLimit();
+    while (undoStack_.size() > 1
+           && ((maxEntries > 0 && undoStack_.size() > maxEntries) || (maxCost > 0 && undoCost_ > maxCost))) {
+        Action* a = undoStack_.first();
+        undoStack_.remove(0);
+        undoCost_ -= a->cost();
+        delete a;
+
+        // the entry can still be undone from the journal
+        QList<qint64> steps = undoSteps_.first();
+        undoSteps_.remove(0);
+        if (journal_ != NULL && !steps.isEmpty() && !steps.contains(-1)) {
+            pagedSteps_.push(steps);
+        } else {
+            pagedSteps_.clear();
+        }
+    }
+}
+
+void ActionStack::pageIn()
+{
+    QList<qint64> steps = pagedSteps_.pop();
+    QList<journal::Op> ops;
+    foreach (qint64 step, steps) {
+        ops += journal_->readStep(step);
+    }
+
+    Action* a = new actions::ReplayStep(ops, root_, diagram_);
+    undoStack_.push(a);
+    undoSteps_.push(steps);
+    undoCost_ += a->cost();
+}
+
+QList<qint64> ActionStack::writeStep(const QList<journal::Op> &ops)
+{
+    QList<qint64> res;
+    if (journal_ != NULL && journal_->isOpen()) {
+        res.append(journal_->writeStep(ops));
+    }
+
+    return res;
+}
+
+QSet<qint64> ActionStack::journalSteps() const
+{
+    QSet<qint64> res;
+    foreach (const QList<qint64>& steps, undoSteps_ + redoSteps_ + pagedSteps_) {
+        res += steps.toSet();
+    }
+    res.remove(-1);
+
+    return res;
+}
+
+void ActionStack::moveJournalSteps(const QHash<qint64, qint64> &moved)
+{
+    moveSteps(undoSteps_, moved);
+    moveSteps(redoSteps_, moved);
+    moveSteps(pagedSteps_, moved);
+}
+
+void ActionStack::moveSteps(QStack<QList<qint64> > &stack, const QHash<qint64, qint64> &moved)
+{
+    for (int i = 0; i<stack.size(); i++) {
+        QList<qint64>& steps = stack[i];
+        for (int j = 0; j<steps.size(); j++) {
+            steps[j] = moved.value(steps[j], -1);
+        }
+    }
+}
+
+void ActionStack::setJournal(EditJournal *journal, Node *root)
+{
+    journal_ = journal;
+    root_ = root;
+}
+
 bool ActionStack::canUndo() const
 {
-    return !undoStack_.isEmpty();
+    return !undoStack_.isEmpty() || !pagedSteps_.isEmpty();
 }
 
 bool ActionStack::canRedo() const
@@ -77,105 +368,235 @@ bool ActionStack::canRedo() const
 
 namespace actions
 {
+namespace
+{
+Box* boxFor(Diagram* d, Node* node)
+{
+    DiagramElement* de = d == NULL ? NULL : d->elementFor(node);
+    return de == NULL || de == d ? NULL : static_cast<Box*>(de);
+}
+
+void attachProperty(Diagram* d, Node* node, Property* prop, QPointer<PropertyWidget>& pw)
+{
+    Box* b = boxFor(d, node);
+    if (b != NULL && b->showsProperties() && b->propertyWidget(prop) == NULL) {
+        if (pw.isNull() || pw->parentBox() != b) {
+            pw = new PropertyWidget(prop, b);
+        }
+        b->addProperty(pw);
+        pw->show();
+    }
+
+    node->addProperty(prop);
+}
+
+void detachProperty(Diagram* d, Node* node, Property* prop)
+{
+    Box* b = boxFor(d, node);
+    PropertyWidget* pw = b == NULL ? NULL : b->propertyWidget(prop);
+    if (pw != NULL) {
+        b->removeProperty(pw);
+        pw->hide();
+        pw->deleteLater();
+    }
+
+    node->removeProperty(prop);
+}
+
+void attachBox(Diagram* d, Node* parent, Node* node, int pos, QPointer<Box>& box)
+{
+    parent->insertChild(node, pos);
+
+    DiagramElement* de = d == NULL ? NULL : d->elementFor(parent);
+    if (de == NULL || !de->showsChild(node->name()) || de->childBox(node) != NULL) {
+        return;
+    }
+
+    if (box.isNull()) {
+        box = new Box(node, de);
+    }
+
+    de->insertBox(box, de->boxIndexFor(node));
+    box->show();
+    foreach (Box* b, box->boxes()) {
+        b->show();
+    }
+}
+
+// removes the node but keeps its box for reinsertion
+void takeBox(Diagram* d, Node* parent, Node* node, QPointer<Box>& box)
+{
+    DiagramElement* de = d == NULL ? NULL : d->elementFor(parent);
+    Box* b = de == NULL ? NULL : de->childBox(node);
+    if (b != NULL) {
+        box = b;
+        de->removeBox(b);
+        b->hide();
+        foreach (Box* ch, b->boxes()) {
+            ch->hide();
+        }
+    }
+
+    parent->removeChild(node);
+}
+
+void detachBox(Diagram* d, Node* parent, Node* node)
+{
+    QPointer<Box> box;
+    takeBox(d, parent, node, box);
+    if (!box.isNull()) {
+        box->discard();
+    }
+}
+
+PropertyWidget* propertyWidgetFor(Diagram* d, Node* node, Property* prop)
+{
+    Box* b = boxFor(d, node);
+    return b == NULL ? NULL : b->propertyWidget(prop);
+}
+}
+
+ChangeProperty::ChangeProperty(PropertyWidget *prop, const QString &newValue)
+    : data_(prop->data())
+    , node_(prop->parentBox()->data())
+    , diagram_(prop->parentBox()->diagram())
+    , newValue_(newValue)
+    , oldValue_(prop->data()->value())
+{}
+
 void ChangeProperty::execute()
 {
-    prop_->setValue(newValue_);
+    data_->setValue(newValue_);
+    PropertyWidget* pw = propertyWidgetFor(diagram_, node_, data_);
+    if (pw != NULL) {
+        pw->setValue(newValue_);
+    }
 }
 
 void ChangeProperty::undo()
 {
-    prop_->setValue(oldValue_);
+    data_->setValue(oldValue_);
+    PropertyWidget* pw = propertyWidgetFor(diagram_, node_, data_);
+    if (pw != NULL) {
+        pw->setValue(oldValue_);
+    }
+}
+
+bool ChangeProperty::mergeWith(const Action *other)
+{
+    const ChangeProperty* cp = dynamic_cast<const ChangeProperty*>(other);
+    if (cp == NULL || cp->data_ != data_) {
+        return false;
+    }
+
+    newValue_ = cp->newValue_;
+    return true;
+}
+
+void ChangeProperty::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::valueOp(node_, data_, oldValue_, newValue_));
 }
 
 DeleteProperty::DeleteProperty(PropertyWidget *prop)
-    : prop_(prop)
-    , parent_(prop->parentBox())
+    : data_(prop->data())
+    , node_(prop->parentBox()->data())
+    , index_(node_->properties().indexOf(data_))
+    , diagram_(prop->parentBox()->diagram())
     , executed_(false)
 {}
 
 void DeleteProperty::execute()
 {
-    parent_->removeProperty(prop_);
-    parent_->data()->removeProperty(prop_->data());
-    prop_->hide();
+    detachProperty(diagram_, node_, data_);
     executed_ = true;
 }
 
 void DeleteProperty::undo()
 {
-    parent_->addProperty(prop_);
-    parent_->data()->addProperty(prop_->data());
-    prop_->show();
+    QPointer<PropertyWidget> pw;
+    attachProperty(diagram_, node_, data_, pw);
     executed_ = false;
 }
 
+void DeleteProperty::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::propertyOp(journal::Op::REMOVE_PROPERTY, node_, data_, index_));
+}
+
 DeleteProperty::~DeleteProperty()
 {
     if (executed_) {
-        prop_->deleteLater();
-        prop_->data()->deleteLater();
+        data_->deleteLater();
     }
 }
 
+AddProperty::AddProperty(PropertyWidget *prop, Box *to)
+    : prop_(prop)
+    , data_(prop->data())
+    , node_(to->data())
+    , diagram_(to->diagram())
+    , executed_(false)
+{}
+
 void AddProperty::execute()
 {
-    parent_->addProperty(prop_);
-    parent_->data()->addProperty(prop_->data());
-    prop_->show();
+    attachProperty(diagram_, node_, data_, prop_);
     executed_ = true;
 }
 
 void AddProperty::undo()
 {
-    parent_->removeProperty(prop_);
-    parent_->data()->removeProperty(prop_->data());
-    prop_->hide();
+    detachProperty(diagram_, node_, data_);
+    prop_ = NULL;
     executed_ = false;
 }
 
+void AddProperty::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::propertyOp(journal::Op::ADD_PROPERTY, node_, data_, node_->properties().indexOf(data_)));
+}
+
 AddProperty::~AddProperty()
 {
     if (!executed_) {
-        prop_->deleteLater();
-        prop_->data()->deleteLater();
+        if (!prop_.isNull()) {
+            prop_->deleteLater();
+        }
+        data_->deleteLater();
     }
 }
 
 DeleteBox::DeleteBox(Box* b)
-    : box_(b)
-    , pos_(b->parentElement()->indexOf(b))
-    , parent_(b->parentElement())
+    : node_(b->data())
+    , parent_(b->parentElement()->data())
+    , pos_(parent_->children().indexOf(node_))
+    , diagram_(b->diagram())
     , executed_(false)
 {}
 
 void DeleteBox::execute()
 {
-    parent_->removeBox(box_);
-    parent_->data()->removeChild(box_->data());
-    box_->hide();
-    foreach (Box* b, box_->boxes()) {
-        b->hide();
-    }
-
+    detachBox(diagram_, parent_, node_);
     executed_ = true;
 }
 
 void DeleteBox::undo()
 {
-    parent_->insertBox(box_, pos_);
-    parent_->data()->insertChild(box_->data(), pos_);
-    box_->show();
-    foreach (Box* b, box_->boxes()) {
-        b->show();
-    }
+    QPointer<Box> box;
+    attachBox(diagram_, parent_, node_, pos_, box);
     executed_ = false;
 }
 
+void DeleteBox::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::nodeOp(journal::Op::REMOVE_NODE, parent_, pos_, node_));
+}
+
 DeleteBox::~DeleteBox()
 {
     if (executed_) {
-        box_->deleteLater();
-        box_->data()->deleteLater();
+        node_->deleteLater();
     }
 }
 
@@ -183,62 +604,265 @@ DeleteBox::~DeleteBox()
 
 InsertBox::InsertBox(Box *b, int pos, DiagramElement *to)
     : box_(b)
-    , pos_(pos)
-    , parent_(to)
+    , node_(b->data())
+    , parent_(to->data())
+    , pos_(to->data()->children().contains(b->data()) ? to->data()->children().indexOf(b->data()) : to->nodeIndexFor(pos))
+    , diagram_(to->diagram())
     , executed_(false)
 {}
 
 void InsertBox::execute()
 {
-    parent_->insertBox(box_, pos_);
-    parent_->data()->insertChild(box_->data(), pos_);
-    box_->show();
-    foreach (Box* b, box_->boxes()) {
-        b->show();
-    }
+    attachBox(diagram_, parent_, node_, pos_, box_);
     executed_ = true;
 }
 
 void InsertBox::undo()
 {
-    parent_->removeBox(box_);
-    parent_->data()->removeChild(box_->data());
-    box_->hide();
-    foreach (Box* b, box_->boxes()) {
-        b->hide();
-    }
+    detachBox(diagram_, parent_, node_);
+    box_ = NULL;
     executed_ = false;
 }
 
+void InsertBox::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::nodeOp(journal::Op::INSERT_NODE, parent_, pos_, node_));
+}
+
 InsertBox::~InsertBox()
 {
     if (!executed_) {
-        box_->deleteLater();
-        box_->data()->deleteLater();
+        if (!box_.isNull()) {
+            box_->deleteLater();
+        }
+        node_->deleteLater();
     }
 }
 
 MoveBox::MoveBox(Box *b, int pos)
     : box_(b)
-    , src_(b->parentElement()->indexOf(b))
-    , dst_(pos)
-    , parent_(b->parentElement())
+    , node_(b->data())
+    , parent_(b->parentElement()->data())
+    , src_(parent_->children().indexOf(node_))
+    , dst_(b->parentElement()->nodeIndexFor(pos))
+    , diagram_(b->diagram())
 {}
 
 void MoveBox::execute()
 {
     int dst = dst_ > src_ ? dst_ - 1 : dst_;
-    parent_->removeBox(box_, false);
-    parent_->data()->removeChild(box_->data());
-    parent_->insertBox(box_, dst);
-    parent_->data()->insertChild(box_->data(), dst);
+    takeBox(diagram_, parent_, node_, box_);
+    attachBox(diagram_, parent_, node_, dst, box_);
 }
 
 void MoveBox::undo()
 {
-    parent_->removeBox(box_, false);
-    parent_->data()->removeChild(box_->data());
-    parent_->insertBox(box_, src_);
-    parent_->data()->insertChild(box_->data(), src_);
+    takeBox(diagram_, parent_, node_, box_);
+    attachBox(diagram_, parent_, node_, src_, box_);
+}
+
+void MoveBox::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::moveOp(parent_, src_, parent_->children().indexOf(node_)));
+}
+
+InsertNode::~InsertNode()
+{
+    if (!executed_) {
+        node_->deleteLater();
+    }
+}
+
+bool SetPropertyValue::mergeWith(const Action *other)
+{
+    const SetPropertyValue* sp = dynamic_cast<const SetPropertyValue*>(other);
+    if (sp == NULL || sp->prop_ != prop_) {
+        return false;
+    }
+
+    newValue_ = sp->newValue_;
+    return true;
+}
+
+void InsertNode::execute()
+{
+    parent_->insertChild(node_, pos_);
+    executed_ = true;
+}
+
+void InsertNode::undo()
+{
+    parent_->removeChild(node_);
+    executed_ = false;
+}
+
+void InsertNode::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::nodeOp(journal::Op::INSERT_NODE, parent_, pos_, node_));
+}
+
+RemoveNode::RemoveNode(Node *n)
+    : node_(n)
+    , parent_(n->parentNode())
+    , pos_(n->parentNode()->children().indexOf(n))
+    , executed_(false)
+{}
+
+RemoveNode::~RemoveNode()
+{
+    if (executed_) {
+        node_->deleteLater();
+    }
+}
+
+void RemoveNode::execute()
+{
+    parent_->removeChild(node_);
+    executed_ = true;
+}
+
+void RemoveNode::undo()
+{
+    parent_->insertChild(node_, pos_);
+    executed_ = false;
+}
+
+void RemoveNode::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::nodeOp(journal::Op::REMOVE_NODE, parent_, pos_, node_));
+}
+
+AddNodeProperty::~AddNodeProperty()
+{
+    if (!executed_) {
+        prop_->deleteLater();
+    }
+}
+
+void AddNodeProperty::execute()
+{
+    node_->addProperty(prop_);
+    executed_ = true;
+}
+
+void AddNodeProperty::undo()
+{
+    node_->removeProperty(prop_);
+    executed_ = false;
+}
+
+void AddNodeProperty::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::propertyOp(journal::Op::ADD_PROPERTY, node_, prop_, node_->properties().indexOf(prop_)));
+}
+
+RemoveNodeProperty::~RemoveNodeProperty()
+{
+    if (executed_) {
+        prop_->deleteLater();
+    }
+}
+
+void RemoveNodeProperty::execute()
+{
+    node_->removeProperty(prop_);
+    executed_ = true;
+}
+
+void RemoveNodeProperty::undo()
+{
+    node_->addProperty(prop_);
+    executed_ = false;
+}
+
+void RemoveNodeProperty::record(QList<journal::Op> &ops) const
+{
+    ops.append(journal::propertyOp(journal::Op::REMOVE_PROPERTY, node_, prop_, index_));
+}
+
+void ReplayStep::execute()
+{
+    foreach (const journal::Op& op, ops_) {
+        apply(op, true);
+    }
+}
+
+void ReplayStep::undo()
+{
+    for (int i = ops_.size() - 1; i >= 0; i--) {
+        apply(ops_[i], false);
+    }
+}
+
+qint64 ReplayStep::cost() const
+{
+    qint64 res = sizeof(*this);
+    foreach (const journal::Op& op, ops_) {
+        res += journal::cost(op);
+    }
+
+    return res;
+}
+
+// same as journal::apply, but keeps the boxes of the diagram in sync
+void ReplayStep::apply(const journal::Op &op, bool forward)
+{
+    Node* n = journal::nodeAt(root_, op.node);
+    if (n == NULL) {
+        return;
+    }
+
+    QPointer<Box> box;
+    QPointer<PropertyWidget> pw;
+
+    switch (op.type) {
+    case journal::Op::INSERT_NODE:
+    case journal::Op::REMOVE_NODE:
+        if ((op.type == journal::Op::INSERT_NODE) == forward) {
+            Node* ch = journal::deserialize(op.data);
+            if (ch != NULL && op.index >= 0 && op.index <= n->children().size()) {
+                attachBox(diagram_, n, ch, op.index, box);
+            } else {
+                delete ch;
+            }
+        } else if (op.index >= 0 && op.index < n->children().size()) {
+            Node* ch = n->children()[op.index];
+            detachBox(diagram_, n, ch);
+            ch->deleteLater();
+        }
+        break;
+    case journal::Op::MOVE_NODE:
+    {
+        int from = forward ? op.index : op.index2;
+        int to = forward ? op.index2 : op.index;
+        if (from >= 0 && from < n->children().size() && to >= 0 && to < n->children().size()) {
+            Node* ch = n->children()[from];
+            takeBox(diagram_, n, ch, box);
+            attachBox(diagram_, n, ch, to, box);
+        }
+        break;
+    }
+    case journal::Op::SET_VALUE:
+        if (op.index >= 0 && op.index < n->properties().size()) {
+            Property* p = n->properties()[op.index];
+            const QString& value = forward ? op.value : op.oldValue;
+            p->setValue(value);
+            PropertyWidget* widget = propertyWidgetFor(diagram_, n, p);
+            if (widget != NULL) {
+                widget->setValue(value);
+            }
+        }
+        break;
+    case journal::Op::ADD_PROPERTY:
+    case journal::Op::REMOVE_PROPERTY:
+        if ((op.type == journal::Op::ADD_PROPERTY) == forward) {
+            attachProperty(diagram_, n, new Property(op.name, op.value), pw);
+        } else if (op.index >= 0 && op.index < n->properties().size()) {
+            Property* p = n->properties()[op.index];
+            detachProperty(diagram_, n, p);
+            p->deleteLater();
+        }
+        break;
+    }
 }
 }
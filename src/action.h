@@ -22,8 +22,13 @@
 #define ACTION_H
 
 #include <QStack>
+#include <QSet>
+#include <QHash>
+#include <QPointer>
+#include <QElapsedTimer>
 #include "node.h"
 #include "propertywidget.h"
+#include "journal.h"
 
 class Action
 {
@@ -31,12 +36,54 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
 
+    // Folds an action performed right after this one into it, returns false
+    // if the two can't be merged. other is deleted after a successful merge.
+    virtual bool mergeWith(const Action* other) { Q_UNUSED(other); return false; }
+
+    // rough estimate of the memory kept alive by the action
+    virtual qint64 cost() const { return sizeof(Action); }
+
+    // Appends the model level operations of the action, called right after
+    // its first execution.
+    virtual void record(QList<journal::Op>& ops) const { Q_UNUSED(ops); }
+
+    // the node whose subtree the action changes, NULL if it isn't known
+    virtual Node* target() const { return NULL; }
+
     virtual ~Action() {}
 
 protected:
     Action() {}
 };
 
+// A sequence of actions done and undone as one.
+class CompoundAction : public Action
+{
+public:
+    CompoundAction() : actions_(), ops_(), recorded_(false) {}
+    ~CompoundAction();
+
+    // for actions that are already executed
+    void add(Action* a);
+    bool isEmpty() const { return actions_.isEmpty(); }
+
+    void execute();
+    void undo();
+    qint64 cost() const;
+    void record(QList<journal::Op>& ops) const { ops += ops_; }
+    // the nearest common ancestor of the targets of the actions
+    Node* target() const;
+
+private:
+    // the operations are collected one by one, since the paths in them are
+    // only valid right after the action they belong to
+    QList<Action*> actions_;
+    QList<journal::Op> ops_;
+    bool recorded_;
+};
+
+class Diagram;
+
 class ActionStack : public QObject
 {
     Q_OBJECT
@@ -48,17 +95,60 @@ public:
     void undo();
     void redo();
 
+    // Actions pushed during a transaction are executed right away, but
+    // actionPerformed is only emitted once, on commit or on rolling back the
+    // outermost transaction, and they are undone as a single step. Views
+    // suspend their layout between transactionStarted and
+    // transactionFinished. Transactions can be nested.
+    void beginTransaction();
+    void commitTransaction();
+    void rollbackTransaction();
+    bool inTransaction() const { return !transactions_.isEmpty(); }
+
     bool canUndo() const;
     bool canRedo() const;
 
+    // Writes every undo step to the journal of the document. Steps dropped
+    // from memory are read back from it when they are undone; root is the
+    // root of the file and diagram, if set, is updated by these steps.
+    void setJournal(EditJournal* journal, Node* root);
+    void setDiagram(Diagram* diagram) { diagram_ = diagram; }
+    // the journal offsets referenced by the undo and redo history
+    QSet<qint64> journalSteps() const;
+    // follows EditJournal::compact
+    void moveJournalSteps(const QHash<qint64, qint64>& moved);
+
 signals:
+    // changed is the target of the action done or undone, see Action::target;
+    // emitted right before actionPerformed
+    void nodeChanged(Node* changed);
     void actionPerformed();
+    void transactionStarted();
+    void transactionFinished();
 
 private:
     ActionStack(const ActionStack&);
+    void performed(Action* a);
+    void clearRedo();
+    void trim();
+    void pageIn();
+    QList<qint64> writeStep(const QList<journal::Op>& ops);
+    static void moveSteps(QStack<QList<qint64> >& stack, const QHash<qint64, qint64>& moved);
 
     QStack<Action*> undoStack_;
     QStack<Action*> redoStack_;
+    QStack<CompoundAction*> transactions_;
+    // journal offsets of the entries of the stacks, more than one if
+    // actions were merged
+    QStack<QList<qint64> > undoSteps_;
+    QStack<QList<qint64> > redoSteps_;
+    QStack<QList<qint64> > pagedSteps_;
+    EditJournal* journal_;
+    Node* root_;
+    Diagram* diagram_;
+    qint64 undoCost_;
+    QElapsedTimer lastPush_;
+    bool canMerge_;
 };
 
 class Box;
@@ -67,20 +157,30 @@ class DiagramElement;
 namespace actions
 {
 
+// The widget actions below work on the node model and identify their targets
+// by node, because boxes and property widgets are released when their box is
+// collapsed. The widgets of removed nodes are destroyed right away and the
+// detached nodes are all an undo entry keeps; the widgets are built again
+// when the removal is undone.
+
 class ChangeProperty : public Action
 {
 public:
-    ChangeProperty(PropertyWidget* prop, const QString& newValue)
-        : prop_(prop)
-        , newValue_(newValue)
-        , oldValue_(prop->value())
-    {}
+    // the property itself still has the old value at this point, the widget
+    // may already show the new one
+    ChangeProperty(PropertyWidget* prop, const QString& newValue);
 
     virtual void execute();
     virtual void undo();
+    bool mergeWith(const Action* other);
+    qint64 cost() const { return sizeof(*this) + (newValue_.size() + oldValue_.size()) * sizeof(QChar); }
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return node_; }
 
 private:
-    PropertyWidget* prop_;
+    Property* data_;
+    Node* node_;
+    Diagram* diagram_;
     QString newValue_;
     QString oldValue_;
 };
@@ -94,30 +194,34 @@ public:
 
     void execute();
     void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return node_; }
 
 private:
-    PropertyWidget* prop_;
-    Box* parent_;
+    Property* data_;
+    Node* node_;
+    int index_;
+    Diagram* diagram_;
     bool executed_;
 };
 
 class AddProperty : public Action
 {
 public:
-    AddProperty(PropertyWidget* prop, Box* to)
-        : prop_(prop)
-        , parent_(to)
-        , executed_(false)
-    {}
+    AddProperty(PropertyWidget* prop, Box* to);
 
     ~AddProperty();
 
     void execute();
     void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return node_; }
 
 private:
-    PropertyWidget* prop_;
-    Box* parent_;
+    QPointer<PropertyWidget> prop_;
+    Property* data_;
+    Node* node_;
+    Diagram* diagram_;
     bool executed_;
 };
 
@@ -130,11 +234,14 @@ public:
 
     void execute();
     void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return parent_; }
 
 private:
-    Box* box_;
+    Node* node_;
+    Node* parent_;
     int pos_;
-    DiagramElement* parent_;
+    Diagram* diagram_;
     bool executed_;
 };
 
@@ -147,11 +254,15 @@ public:
 
     void execute();
     void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return parent_; }
 
 private:
-    Box* box_;
+    QPointer<Box> box_;
+    Node* node_;
+    Node* parent_;
     int pos_;
-    DiagramElement* parent_;
+    Diagram* diagram_;
     bool executed_;
 };
 
@@ -162,12 +273,153 @@ public:
 
     void execute();
     void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return parent_; }
 
 private:
-    Box* box_;
+    QPointer<Box> box_;
+    Node* node_;
+    Node* parent_;
     int src_;
     int dst_;
-    DiagramElement* parent_;
+    Diagram* diagram_;
+};
+
+class InsertNode : public Action
+{
+public:
+    InsertNode(Node* n, Node* to, int pos)
+        : node_(n)
+        , parent_(to)
+        , pos_(pos)
+        , executed_(false)
+    {}
+
+    ~InsertNode();
+
+    void execute();
+    void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return parent_; }
+
+private:
+    Node* node_;
+    Node* parent_;
+    int pos_;
+    bool executed_;
+};
+
+class RemoveNode : public Action
+{
+public:
+    RemoveNode(Node* n);
+
+    ~RemoveNode();
+
+    void execute();
+    void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return parent_; }
+
+private:
+    Node* node_;
+    Node* parent_;
+    int pos_;
+    bool executed_;
+};
+
+class SetPropertyValue : public Action
+{
+public:
+    SetPropertyValue(Property* prop, Node* node, const QString& newValue)
+        : prop_(prop)
+        , node_(node)
+        , newValue_(newValue)
+        , oldValue_(prop->value())
+    {}
+
+    void execute() { prop_->setValue(newValue_); }
+    void undo() { prop_->setValue(oldValue_); }
+    bool mergeWith(const Action* other);
+    qint64 cost() const { return sizeof(*this) + (newValue_.size() + oldValue_.size()) * sizeof(QChar); }
+    void record(QList<journal::Op>& ops) const { ops.append(journal::valueOp(node_, prop_, oldValue_, newValue_)); }
+    Node* target() const { return node_; }
+
+private:
+    Property* prop_;
+    Node* node_;
+    QString newValue_;
+    QString oldValue_;
+};
+
+class AddNodeProperty : public Action
+{
+public:
+    AddNodeProperty(Property* prop, Node* to)
+        : prop_(prop)
+        , node_(to)
+        , executed_(false)
+    {}
+
+    ~AddNodeProperty();
+
+    void execute();
+    void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return node_; }
+
+private:
+    Property* prop_;
+    Node* node_;
+    bool executed_;
+};
+
+class RemoveNodeProperty : public Action
+{
+public:
+    RemoveNodeProperty(Property* prop, Node* from)
+        : prop_(prop)
+        , node_(from)
+        , index_(from->properties().indexOf(prop))
+        , executed_(false)
+    {}
+
+    ~RemoveNodeProperty();
+
+    void execute();
+    void undo();
+    void record(QList<journal::Op>& ops) const;
+    Node* target() const { return node_; }
+
+private:
+    Property* prop_;
+    Node* node_;
+    int index_;
+    bool executed_;
+};
+
+// An undo step read back from the journal. It works on the model, and on the
+// boxes of the diagram if there is one.
+class ReplayStep : public Action
+{
+public:
+    ReplayStep(const QList<journal::Op>& ops, Node* root, Diagram* diagram)
+        : ops_(ops)
+        , root_(root)
+        , diagram_(diagram)
+    {}
+
+    void execute();
+    void undo();
+    qint64 cost() const;
+    void record(QList<journal::Op>& ops) const { ops += ops_; }
+
+private:
+    void apply(const journal::Op& op, bool forward);
+
+    QList<journal::Op> ops_;
+    Node* root_;
+    Diagram* diagram_;
 };
 
 }
@@ -23,6 +23,7 @@
 #include <QXmlSimpleReader>
 #include <QDebug>
 #include <QRgb>
+#include <QThread>
 
 namespace
 {
@@ -44,6 +45,19 @@ QString formatTextBold(const QString &str)
 {
     return "<b>" + formatTextNormal(str) + "</b>";
 }
+
+QColor heatColor(const QColor &base, qreal heat)
+{
+    if (heat <= 0) {
+        return QColor(210, 210, 210);
+    }
+
+    const QColor hot(240, 70, 40);
+    heat = qMin(heat, qreal(1));
+    return QColor(base.red() + (hot.red() - base.red()) * heat,
+                  base.green() + (hot.green() - base.green()) * heat,
+                  base.blue() + (hot.blue() - base.blue()) * heat);
+}
 }
 
 
@@ -78,6 +92,8 @@ bool VisualSchema::XmlHandler::startElement(const QString&, const QString&, cons
         currentTag_.type = toNodeType(atts.value("type"));
         currentTag_.symIndProxy = atts.value("proxy");
         currentTag_.symProp = atts.value("prop-name");
+        currentTag_.collapsed = atts.index("collapsed") != -1;
+        currentTag_.collapsedChildren = atts.value("collapsed").split(",", QString::SkipEmptyParts);
     } else if (name == "child") {
         currentTag_.children.append(atts.value("name"));
         Connection c;
@@ -242,6 +258,11 @@ Configuration::Configuration()
     , ltProcPath_("/usr/bin/lt-proc")
     , apertiumTransferPath_("/usr/bin/apertium-transfer")
     , apertiumPreprocTransPath_("/usr/bin/apertium-preprocess-transfer")
+    , sceneThreshold_(1000)
+    , undoLimit_(1000)
+    , undoMemoryLimit_(16*1024*1024)
+    , undoMergeInterval_(1500)
+    , toolJobs_(qMax(1, QThread::idealThreadCount()))
 {
     QFile vsfile(fs::visualSchemaFile());
     QXmlInputSource vsinput(&vsfile);
@@ -319,6 +340,10 @@ void FileConfiguration::setSlDictPath(const QString &str)
     vschema_.setTag("def-attr", defattr);
 
     slPath_ = str;
+    slSymbols_.clear();
+    foreach (const QString& sym, symbols) {
+        slSymbols_ << sym.mid(QString("__symbol_").size());
+    }
 }
 
 void FileConfiguration::setTlDictPath(const QString &str)
@@ -81,6 +81,21 @@ public:
 
     struct Tag
     {
+        Tag()
+            : reptype(reptype::BOX)
+            , type(nodetype::STANDARD)
+            , boxColor()
+            , label()
+            , children()
+            , properties()
+            , nesting()
+            , name()
+            , symIndProxy()
+            , symProp()
+            , collapsed(false)
+            , collapsedChildren()
+        {}
+
         reptype::Type reptype;
         nodetype::Type type;
         QColor boxColor;
@@ -91,6 +106,8 @@ public:
         QString name;
         QString symIndProxy;
         QString symProp;
+        bool collapsed;                // boxes start collapsed
+        QStringList collapsedChildren; // children still shown when collapsed
     };
 
     struct Property
@@ -202,11 +219,21 @@ public:
     QString ltProcPath() const { return ltProcPath_; }
     QString apertiumTransferPath() const { return apertiumTransferPath_; }
     QString apertiumPreprocTransPath() const { return apertiumPreprocTransPath_; }
+    int sceneThreshold() const { return sceneThreshold_; }
+    int undoLimit() const { return undoLimit_; }
+    qint64 undoMemoryLimit() const { return undoMemoryLimit_; }
+    int undoMergeInterval() const { return undoMergeInterval_; }
+    int toolJobs() const { return toolJobs_; }
 
     void setLtCompPath(const QString& str) { ltCompPath_ = str; }
     void setLtProcPath(const QString& str) { ltProcPath_ = str; }
     void setApertiumTransferPath(const QString& str) { apertiumTransferPath_ = str; }
     void setApertiumPreprocTransPath(const QString& str) { apertiumPreprocTransPath_ = str; }
+    void setSceneThreshold(int n) { sceneThreshold_ = n; }
+    void setUndoLimit(int n) { undoLimit_ = n; }
+    void setUndoMemoryLimit(qint64 n) { undoMemoryLimit_ = n; }
+    void setUndoMergeInterval(int msecs) { undoMergeInterval_ = msecs; }
+    void setToolJobs(int n) { toolJobs_ = n; }
 
 private:
     Configuration();
@@ -232,6 +259,12 @@ private:
     QString ltProcPath_;
     QString apertiumTransferPath_;
     QString apertiumPreprocTransPath_;
+    int sceneThreshold_;
+    int undoLimit_;
+    qint64 undoMemoryLimit_;
+    int undoMergeInterval_;
+    // number of tool processes run at once
+    int toolJobs_;
 };
 
 class FileConfiguration
@@ -250,6 +283,8 @@ public:
     const QString& slDictPath() const { return slPath_; }
     const QString& tlDictPath() const { return tlPath_; }
     const QString& biDictPath() const { return biPath_; }
+    // the sdefs of the source language dictionary, without the __symbol_ prefix
+    const QStringList& slSymbols() const { return slSymbols_; }
 
     void setSlDictPath(const QString& str);
     void setTlDictPath(const QString& str);
@@ -273,6 +308,7 @@ private:
 
     VisualSchema vschema_;
     QString slPath_, tlPath_, biPath_;
+    QStringList slSymbols_;
 };
 
 namespace appearance
@@ -280,6 +316,8 @@ namespace appearance
 inline QColor fontColor() { return Qt::black; }
 QString formatTextNormal(const QString& str);
 QString formatTextBold(const QString& str);
+// colour of a box in a heatmap, heat is between 0 (never used) and 1
+QColor heatColor(const QColor& base, qreal heat);
 }
 
 #endif // CONFIG_H
@@ -0,0 +1,385 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "corpus.h"
+#include "config.h"
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+#include <QEventLoop>
+#include <QtAlgorithms>
+
+CorpusRunner::CorpusRunner(const ToolsManager *tools, QObject *parent)
+    : QObject(parent)
+    , tools_(tools)
+    , last_(ToolsManager::GENERATE)
+    , sentences_()
+    , shards_()
+    , next_(0)
+    , done_(0)
+    , running_(false)
+    , wallTimer_()
+    , wallMsecs_(0)
+{}
+
+CorpusRunner::~CorpusRunner()
+{
+    stop();
+}
+
+bool CorpusRunner::load(const QString &path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    sentences_.clear();
+    QTextStream in(&f);
+    in.setCodec("UTF-8");
+    int line = 0;
+    while (!in.atEnd()) {
+        QString l = in.readLine();
+        line++;
+        if (l.trimmed().isEmpty() || l.startsWith('#')) {
+            continue;
+        }
+
+        int tab = l.indexOf('\t');
+        if (tab == -1) {
+            sentences_.append(Sentence(line, l));
+        } else {
+            sentences_.append(Sentence(line, l.left(tab), l.mid(tab+1), true));
+        }
+    }
+
+    return true;
+}
+
+void CorpusRunner::start(int shards)
+{
+    stop();
+
+    for (int i = 0; i<sentences_.size(); i++) {
+        const Sentence& s = sentences_[i];
+        sentences_[i] = Sentence(s.line, s.input, s.expected, s.hasExpected);
+    }
+    next_ = 0;
+    done_ = 0;
+    running_ = true;
+    wallTimer_.start();
+
+    // no point in starting more workers than there are sentences
+    shards = qMax(1, qMin(shards, sentences_.size()));
+    for (int i = 0; i<shards; i++) {
+        Shard shard;
+        for (int stage = ToolsManager::MORPH; stage <= last_; stage++) {
+            ToolWorker* w = new ToolWorker(this);
+            w->setCommand(tools_->stageCommand(ToolsManager::Stage(stage)), tools_->stageBinaries(ToolsManager::Stage(stage)));
+            connect(w, SIGNAL(answered(QString,int)), this, SLOT(answered(QString,int)));
+            connect(w, SIGNAL(failed(QString,int)), this, SLOT(failed(QString,int)));
+            shard.workers.append(w);
+        }
+        shards_.append(shard);
+    }
+
+    emit progress(0, sentences_.size());
+    if (sentences_.isEmpty()) {
+        stop();
+        emit finished();
+        return;
+    }
+
+    for (int i = 0; i<shards_.size(); i++) {
+        next(i);
+    }
+}
+
+void CorpusRunner::cancel()
+{
+    if (running_) {
+        stop();
+        emit finished();
+    }
+}
+
+void CorpusRunner::stop()
+{
+    if (running_) {
+        wallMsecs_ = wallTimer_.elapsed();
+    }
+    running_ = false;
+
+    foreach (const Shard& shard, shards_) {
+        foreach (ToolWorker* w, shard.workers) {
+            w->disconnect(this);
+            w->deleteLater();
+        }
+    }
+    shards_.clear();
+}
+
+void CorpusRunner::next(int shard)
+{
+    Shard& s = shards_[shard];
+    if (next_ >= sentences_.size()) {
+        s.sentence = -1;
+        return;
+    }
+
+    s.sentence = next_++;
+    s.stage = ToolsManager::MORPH;
+    s.timer.start();
+    s.workers[s.stage]->request(sentences_[s.sentence].input, shard);
+}
+
+void CorpusRunner::answered(const QString &out, int shard)
+{
+    if (shard >= shards_.size() || shards_[shard].sentence == -1) {
+        return;
+    }
+
+    Shard& s = shards_[shard];
+    Sentence& sentence = sentences_[s.sentence];
+    sentence.usecs[s.stage] = s.timer.nsecsElapsed() / 1000;
+
+    const QString result = s.stage == ToolsManager::MORPH ? ToolsManager::stripSurfaceForms(out) : out;
+    if (s.stage == last_) {
+        sentence.output = result;
+        finishSentence(shard);
+        return;
+    }
+
+    s.stage = ToolsManager::Stage(s.stage + 1);
+    s.timer.start();
+    s.workers[s.stage]->request(result, shard);
+}
+
+void CorpusRunner::failed(const QString &error, int shard)
+{
+    if (shard >= shards_.size() || shards_[shard].sentence == -1) {
+        return;
+    }
+
+    sentences_[shards_[shard].sentence].error = error.trimmed();
+    finishSentence(shard);
+}
+
+void CorpusRunner::finishSentence(int shard)
+{
+    sentences_[shards_[shard].sentence].done = true;
+    done_++;
+    emit progress(done_, sentences_.size());
+
+    if (done_ == sentences_.size()) {
+        stop();
+        emit finished();
+        return;
+    }
+
+    next(shard);
+}
+
+int CorpusRunner::passed() const
+{
+    int n = 0;
+    foreach (const Sentence& s, sentences_) {
+        if (s.done && s.hasExpected && s.passed()) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+double CorpusRunner::sentencesPerSecond() const
+{
+    const qint64 msecs = running_ ? wallTimer_.elapsed() : wallMsecs_;
+    return msecs == 0 ? 0 : done_ * 1000.0 / msecs;
+}
+
+qint64 CorpusRunner::percentile(ToolsManager::Stage stage, int p) const
+{
+    QVector<qint64> times;
+    foreach (const Sentence& s, sentences_) {
+        if (s.done && s.error.isEmpty() && s.usecs[stage] > 0) {
+            times.append(s.usecs[stage]);
+        }
+    }
+    if (times.isEmpty()) {
+        return 0;
+    }
+
+    qSort(times);
+    return times[(p * (times.size()-1) + 50) / 100];
+}
+
+QString CorpusRunner::report() const
+{
+    QString res;
+    QTextStream out(&res);
+
+    int expected = 0;
+    foreach (const Sentence& s, sentences_) {
+        if (s.hasExpected) {
+            expected++;
+        }
+    }
+
+    out << tr("%1 of %2 sentences run, %3 of %4 passed")
+           .arg(done_).arg(sentences_.size()).arg(passed()).arg(expected) << "\n";
+    out << tr("%1 sentences/s").arg(sentencesPerSecond(), 0, 'f', 1) << "\n\n";
+
+    const QString names[] = { tr("Analysis"), tr("Transfer"), tr("Generation") };
+    out << tr("Latency (ms)") << "\tp50\tp90\tp99\n";
+    for (int stage = ToolsManager::MORPH; stage <= last_; stage++) {
+        out << names[stage];
+        foreach (int p, QList<int>() << 50 << 90 << 99) {
+            out << "\t" << QString::number(percentile(ToolsManager::Stage(stage), p) / 1000.0, 'f', 2);
+        }
+        out << "\n";
+    }
+
+    foreach (const Sentence& s, sentences_) {
+        if (!s.done || s.passed()) {
+            continue;
+        }
+
+        out << "\n" << tr("Line %1: %2").arg(s.line).arg(s.input) << "\n";
+        if (!s.error.isEmpty()) {
+            out << "  " << tr("error: %1").arg(s.error) << "\n";
+            continue;
+        }
+        out << "  " << tr("expected: %1").arg(s.expected.trimmed()) << "\n";
+        out << "  " << tr("got:      %1").arg(s.output.trimmed()) << "\n";
+        out << "  " << tr("diff:     %1").arg(wordDiff(s.expected, s.output)) << "\n";
+    }
+
+    out.flush();
+    return res;
+}
+
+QString CorpusRunner::wordDiff(const QString &expected, const QString &got)
+{
+    const QStringList a = expected.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    const QStringList b = got.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+
+    // longest common subsequence of the words, lcs[i][j] is the length for
+    // the suffixes starting at i and j
+    QVector<QVector<int> > lcs(a.size()+1, QVector<int>(b.size()+1, 0));
+    for (int i = a.size()-1; i>=0; i--) {
+        for (int j = b.size()-1; j>=0; j--) {
+            lcs[i][j] = a[i] == b[j] ? lcs[i+1][j+1] + 1 : qMax(lcs[i+1][j], lcs[i][j+1]);
+        }
+    }
+
+    QStringList res;
+    int i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (i < a.size() && j < b.size() && a[i] == b[j]) {
+            res.append(a[i]);
+            i++;
+            j++;
+        } else if (j < b.size() && (i == a.size() || lcs[i][j+1] >= lcs[i+1][j])) {
+            res.append("{+" + b[j] + "+}");
+            j++;
+        } else {
+            res.append("[-" + a[i] + "-]");
+            i++;
+        }
+    }
+
+    return res.join(" ");
+}
+
+int runCorpusHeadless(const QStringList &args)
+{
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+
+    QString corpus, sl, tl, bi, rules;
+    int jobs = appConfig().toolJobs();
+    ToolsManager::Stage last = ToolsManager::GENERATE;
+    for (int i = 1; i<args.size(); i++) {
+        const QString& arg = args[i];
+        const QString value = i+1 < args.size() ? args[i+1] : QString();
+        if (arg == "--corpus") {
+            corpus = value;
+        } else if (arg == "--sl") {
+            sl = value;
+        } else if (arg == "--tl") {
+            tl = value;
+        } else if (arg == "--bi") {
+            bi = value;
+        } else if (arg == "--rules") {
+            rules = value;
+        } else if (arg == "--jobs") {
+            jobs = value.toInt();
+        } else if (arg == "--stage") {
+            last = value == "morph" ? ToolsManager::MORPH : value == "transfer" ? ToolsManager::TRANSFER : ToolsManager::GENERATE;
+        } else {
+            continue;
+        }
+        i++;
+    }
+
+    if (corpus.isEmpty() || sl.isEmpty() || tl.isEmpty() || bi.isEmpty() || rules.isEmpty()) {
+        err << "usage: " << args.value(0) << " --corpus FILE --sl DICT --tl DICT --bi DICT --rules FILE"
+            << " [--jobs N] [--stage morph|transfer|generate]\n";
+        return 2;
+    }
+
+    ToolsManager tools(sl, tl, bi, rules);
+    CorpusRunner runner(&tools);
+    runner.setLastStage(last);
+    if (!runner.load(corpus)) {
+        err << "can't read " << corpus << "\n";
+        return 2;
+    }
+
+    QEventLoop loop;
+    QObject::connect(&tools, SIGNAL(compileFinished(bool)), &loop, SLOT(quit()));
+    tools.compile();
+    if (tools.isCompiling()) {
+        loop.exec();
+    }
+    foreach (const ToolsManager::CompileStep& s, tools.compileSteps()) {
+        if (s.state == ToolsManager::CompileStep::FAILED) {
+            err << "compilation failed: " << s.name << "\n" << s.errors << "\n";
+            return 2;
+        }
+    }
+
+    QObject::connect(&runner, SIGNAL(finished()), &loop, SLOT(quit()));
+    runner.start(jobs);
+    if (runner.isRunning()) {
+        loop.exec();
+    }
+
+    out << runner.report();
+    foreach (const CorpusRunner::Sentence& s, runner.sentences()) {
+        if (!s.done || !s.passed()) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
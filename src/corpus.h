@@ -0,0 +1,132 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QElapsedTimer>
+#include "tools.h"
+
+// Runs a regression corpus through the tools. The corpus is a text file with a
+// sentence and its expected output on each line, separated by a tab; empty
+// lines and lines starting with # are skipped, and sentences without an
+// expected output are only run. The sentences are sharded over a number of
+// independent worker sets, each running one sentence at a time through the
+// stages, so the time spent in every stage can be measured.
+class CorpusRunner : public QObject
+{
+    Q_OBJECT
+public:
+    struct Sentence
+    {
+        Sentence(int l = 0, const QString& in = QString(), const QString& exp = QString(), bool hasExp = false)
+            : line(l)
+            , input(in)
+            , expected(exp)
+            , hasExpected(hasExp)
+            , output()
+            , error()
+            , usecs(3, 0)
+            , done(false)
+        {}
+
+        bool passed() const { return error.isEmpty() && (!hasExpected || output.trimmed() == expected.trimmed()); }
+
+        int line;
+        QString input;
+        QString expected;
+        bool hasExpected;
+        QString output;
+        QString error;
+        // time spent in each stage, indexed by ToolsManager::Stage
+        QVector<qint64> usecs;
+        // shards finish out of order, the sentences done aren't the first ones
+        bool done;
+    };
+
+    CorpusRunner(const ToolsManager* tools, QObject* parent = NULL);
+    ~CorpusRunner();
+
+    // returns false if the file can't be read
+    bool load(const QString& path);
+    void setLastStage(ToolsManager::Stage stage) { last_ = stage; }
+    void start(int shards);
+    void cancel();
+
+    bool isRunning() const { return running_; }
+    const QList<Sentence>& sentences() const { return sentences_; }
+    int done() const { return done_; }
+    int passed() const;
+    double sentencesPerSecond() const;
+    // p-th percentile of the time spent in a stage, in microseconds
+    qint64 percentile(ToolsManager::Stage stage, int p) const;
+    QString report() const;
+
+    // words of got missing from expected are marked with {+ +}, the missing
+    // ones with [- -]
+    static QString wordDiff(const QString& expected, const QString& got);
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void answered(const QString& out, int shard);
+    void failed(const QString& error, int shard);
+
+private:
+    struct Shard
+    {
+        Shard()
+            : workers()
+            , sentence(-1)
+            , stage(ToolsManager::MORPH)
+            , timer()
+        {}
+
+        QList<ToolWorker*> workers;
+        int sentence;
+        ToolsManager::Stage stage;
+        QElapsedTimer timer;
+    };
+
+    void next(int shard);
+    void finishSentence(int shard);
+    void stop();
+
+    const ToolsManager* tools_;
+    ToolsManager::Stage last_;
+    QList<Sentence> sentences_;
+    QList<Shard> shards_;
+    int next_;
+    int done_;
+    bool running_;
+    QElapsedTimer wallTimer_;
+    qint64 wallMsecs_;
+};
+
+// Compiles the files given on the command line and runs a corpus through
+// them without the GUI, printing the report. Returns the exit code.
+int runCorpusHeadless(const QStringList& args);
+
+#endif // CORPUS_H
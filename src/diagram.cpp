@@ -21,9 +21,25 @@
 #include "config.h"
 #include "resources.h"
 #include <cmath>
+#include <climits>
+#include <algorithm>
 #include <QPainter>
 #include <QMenu>
+#include <QTimer>
+#include <QtAlgorithms>
 #include <QDebug>
+#ifdef VISRULED_PROFILE
+#include <QElapsedTimer>
+#endif
+
+static QString decodeName(const QMimeData* mime, const QString& format)
+{
+    QString name;
+    QByteArray mdata = mime->data(format);
+    QDataStream stream(&mdata, QIODevice::ReadOnly);
+    stream >> name;
+    return name;
+}
 
 DiagramElement::~DiagramElement()
 {}
@@ -70,28 +86,104 @@ void DiagramElement::clearBoxes()
     updateLayout();
 }
 
+Box* DiagramElement::childBox(Node *n) const
+{
+    foreach (Box* b, boxes_) {
+        if (b->data() == n) {
+            return b;
+        }
+    }
+
+    return NULL;
+}
+
+int DiagramElement::boxIndexFor(Node *n) const
+{
+    const QList<Node*>& children = data_->children();
+    int index = children.indexOf(n);
+    int res = 0;
+    foreach (Box* b, boxes_) {
+        if (b->data() != n && children.indexOf(b->data()) < index) {
+            res++;
+        }
+    }
+
+    return res;
+}
+
+int DiagramElement::nodeIndexFor(int boxPos) const
+{
+    if (boxPos < boxes_.size()) {
+        return data_->children().indexOf(boxes_[boxPos]->data());
+    }
+
+    return data_->children().size();
+}
+
 int DiagramElement::getInsertPosition(int x, int y) const
 {
-    int pos = 0;
+    if (drag_.mime != NULL) {
+        return insertPosition(drag_.offsets, drag_.horizontal ? x : y);
+    }
+
     VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(data_->name());
+    bool horizontal = tdef.nesting == "horizontal";
+    return insertPosition(boxOffsets(horizontal), horizontal ? x : y);
+}
 
-    if (tdef.nesting == "horizontal") {
-        foreach(Box* b, boxes_) {
-            if (b->x() > x) {
-                return pos;
-            }
-            pos++;
-        }
-    } else {
-        foreach(Box* b, boxes_) {
-            if (b->y() > y) {
-                return pos;
-            }
-            pos++;
-        }
+QVector<int> DiagramElement::boxOffsets(bool horizontal) const
+{
+    // running maximum of the box positions: the first box past a point is
+    // the first one where this exceeds it, and it can be binary searched
+    QVector<int> res;
+    res.reserve(boxes_.size());
+    int m = INT_MIN;
+    foreach (Box* b, boxes_) {
+        m = std::max(m, horizontal ? b->x() : b->y());
+        res.append(m);
     }
 
-    return pos;
+    return res;
+}
+
+int DiagramElement::insertPosition(const QVector<int> &offsets, int v)
+{
+    return qUpperBound(offsets.constBegin(), offsets.constEnd(), v) - offsets.constBegin();
+}
+
+const DiagramElement::DragSession& DiagramElement::dragSession(const QDropEvent *ev)
+{
+    // every move event of a drag carries the same mime data, decode it and
+    // look up the schema only once per drag and target
+    if (drag_.mime == ev->mimeData()) {
+        return drag_;
+    }
+
+    const QMimeData* mime = ev->mimeData();
+    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(data_->name());
+
+    drag_ = DragSession();
+    drag_.mime = mime;
+    drag_.horizontal = tdef.nesting == "horizontal";
+    drag_.offsets = boxOffsets(drag_.horizontal);
+
+    if (mime->hasFormat("application/x-dnd-visruledbox")) {
+        drag_.name = decodeName(mime, "application/x-dnd-visruledbox");
+        drag_.childTag = tdef.children.contains(drag_.name);
+        drag_.acceptsChild = drag_.childTag && showsChild(drag_.name);
+    } else if (mime->hasFormat("application/x-dnd-visruledprop")) {
+        drag_.name = decodeName(mime, "application/x-dnd-visruledprop");
+        drag_.acceptsProperty = tdef.properties.contains(drag_.name) && showsProperties();
+    } else if (mime->hasFormat("application/x-dnd-visruledmove")) {
+        drag_.sourceIndex = boxes_.indexOf(static_cast<Box*>(ev->source()));
+    }
+
+    return drag_;
+}
+
+void DiagramElement::endDragSession()
+{
+    drag_ = DragSession();
 }
 
 bool DiagramElement::isChildOf(DiagramElement *de, bool noArrow) const
@@ -119,43 +211,18 @@ bool DiagramElement::isChildOf(DiagramElement *de, bool noArrow) const
 
 void DiagramElement::dragEnterEvent(QDragEnterEvent *ev)
 {
-    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(data_->name());
-    bool accept = false;
-    if (ev->mimeData()->hasFormat("application/x-dnd-visruledbox")) {
-        QString name;
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledbox");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-        stream >> name;
-        accept = tdef.children.contains(name);
-    } else if (ev->mimeData()->hasFormat("application/x-dnd-visruledmove")) {
-        Box* src = static_cast<Box*>(ev->source());
-        int pos = indexOf(src);
-        int insertPos = getInsertPosition(ev->pos().x(), ev->pos().y());
-        if (pos != -1 && (insertPos != pos) && (insertPos != pos+1)) {
-            accept = true;
-        }
-    }
-
-    if (accept) {
-        ev->acceptProposedAction();
-    } else {
-        ev->ignore();
-    }
+    endDragSession();
+    DiagramElement::dragMoveEvent(ev);
 }
 
 void DiagramElement::dragMoveEvent(QDragMoveEvent *ev)
 {
-    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(data_->name());
+    const DragSession& ds = dragSession(ev);
     bool accept = false;
     if (ev->mimeData()->hasFormat("application/x-dnd-visruledbox")) {
-        QString name;
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledbox");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-        stream >> name;
-        accept = tdef.children.contains(name);
+        accept = ds.acceptsChild;
     } else if (ev->mimeData()->hasFormat("application/x-dnd-visruledmove")) {
-        Box* src = static_cast<Box*>(ev->source());
-        int pos = indexOf(src);
+        int pos = ds.sourceIndex;
         int insertPos = getInsertPosition(ev->pos().x(), ev->pos().y());
         if (pos != -1 && (insertPos != pos) && (insertPos != pos+1)) {
             accept = true;
@@ -169,47 +236,66 @@ void DiagramElement::dragMoveEvent(QDragMoveEvent *ev)
     }
 }
 
+void DiagramElement::dragLeaveEvent(QDragLeaveEvent *)
+{
+    endDragSession();
+}
+
 void DiagramElement::dropEvent(QDropEvent *ev)
 {
-    if (ev->mimeData()->hasFormat("application/x-dnd-visruledbox")) {
+    const DragSession& ds = dragSession(ev);
+    if (ev->mimeData()->hasFormat("application/x-dnd-visruledbox") && ds.acceptsChild) {
         ev->accept();
-        QByteArray data = ev->mimeData()->data("application/x-dnd-visruledbox");
-        QDataStream stream(&data, QIODevice::ReadOnly);
 
-        QString name;
-        stream >> name;
-
-        Node* n = Node::create(name, true, data_);
+        // the box comes with its mandatory properties, laid out once
+        actionStack().beginTransaction();
+        Node* n = Node::create(ds.name, true, data_);
         Box* newb = new Box(n, this);
-        actionStack().push(new actions::InsertBox(newb, getInsertPosition(ev->pos().x(), ev->pos().y()), this));
+        int pos = getInsertPosition(ev->pos().x(), ev->pos().y());
+        endDragSession();
+        actionStack().push(new actions::InsertBox(newb, pos, this));
+        actionStack().commitTransaction();
     } else if (ev->mimeData()->hasFormat("application/x-dnd-visruledmove")) {
         Box* src = static_cast<Box*>(ev->source());
         int pos = getInsertPosition(ev->pos().x(), ev->pos().y());
+        endDragSession();
         actionStack().push(new actions::MoveBox(src, pos));
+    } else {
+        endDragSession();
     }
 }
 
 Box::Box(Node *data, DiagramElement *parent)
     : DiagramElement(data, parent, parent)
+    , diagram_(parent->diagram())
     , label_(new QLabel)
     , mainLayout_(NULL)
     , propsContainer_(new QWidget(this))
     , props_()
+    , color_()
+    , layoutDirty_(false)
+    , arrowTarget_(false)
+    , anchor_(NULL)
+    , absPos_()
+    , expanded_(true)
+    , collapsedChildren_()
+    , symbolContainer_(false)
+    , strip_(NULL)
 {
     setContextMenuPolicy(Qt::CustomContextMenu);
     connect(this, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(showContextMenu(QPoint)));
-    foreach(Node* n, data->children()) {
-        Box* ch = new Box(n, this);
-        addBox(ch);
-    }
 
-    foreach(Property* p, data->properties()) {
-        props_.append(new PropertyWidget(p, this));
-    }
+    VisualSchema::Tag tdef = fileConfig(data->filePath()).tag(data->name());
+    expanded_ = !tdef.collapsed;
+    collapsedChildren_ = tdef.collapsedChildren;
+    symbolContainer_ = tdef.type == nodetype::SYMBOL_CONTAINER_DIRECT || tdef.type == nodetype::SYMBOL_CONTAINER_INDIRECT;
+    syncChildren();
 
     propsContainer_->setLayout(new QHBoxLayout());
 
-    updateLayout();
+    // the children are already laid out at this point, so building our own
+    // layout once is enough; the parent will schedule itself when we're added
+    applyLayout();
 }
 
 Box::~Box()
@@ -217,9 +303,11 @@ Box::~Box()
 
 void Box::addBox(Box *b, bool repaint)
 {
-    DiagramElement::addBox(b);
+    DiagramElement::addBox(b, false);
     VisualSchema::Connection cdef = fileConfig(data()->filePath()).connection(data()->name(), b->data()->name());
-    if (cdef.type == contype::ARROW) {
+    b->arrowTarget_ = cdef.type == contype::ARROW;
+    b->invalidateAnchor();
+    if (b->arrowTarget_) {
         setArrow(this, b);
     }
     if (repaint) {
@@ -229,9 +317,11 @@ void Box::addBox(Box *b, bool repaint)
 
 void Box::insertBox(Box *b, int index, bool repaint)
 {
-    DiagramElement::insertBox(b, index);
+    DiagramElement::insertBox(b, index, false);
     VisualSchema::Connection cdef = fileConfig(data()->filePath()).connection(data()->name(), b->data()->name());
-    if (cdef.type == contype::ARROW) {
+    b->arrowTarget_ = cdef.type == contype::ARROW;
+    b->invalidateAnchor();
+    if (b->arrowTarget_) {
         setArrow(this, b);
     }
     if (repaint) {
@@ -255,27 +345,166 @@ void Box::removeProperty(PropertyWidget *pw)
     updateLayout();
 }
 
-int Box::absX() const
+PropertyWidget* Box::propertyWidget(Property *p) const
 {
-    DiagramElement* de = static_cast<DiagramElement*>(parentWidget());
-    return de->absX() + x();
+    foreach (PropertyWidget* pw, props_) {
+        if (pw->data() == p) {
+            return pw;
+        }
+    }
+
+    return NULL;
 }
 
-int Box::absY() const
+bool Box::showsChild(const QString &name) const
 {
-    DiagramElement* de = static_cast<DiagramElement*>(parentWidget());
-    return de->absY() + y();
+    // the symbols of a container are drawn by its symbol strip
+    if (symbolContainer_ && SymbolStrip::isSymbol(name)) {
+        return false;
+    }
+
+    return expanded_ || collapsedChildren_.contains(name);
 }
 
-void Box::paintBackground(QPainter &qp)
+void Box::setExpanded(bool b)
 {
-    VisualSchema::Tag tagdef = fileConfig(data()->filePath()).tag(data()->name());
-    qp.setBrush(tagdef.boxColor);
+    if (b == expanded_) {
+        return;
+    }
+
+    expanded_ = b;
+    syncChildren();
+    updateLayout();
+}
+
+void Box::syncChildren()
+{
+    // create the boxes and property widgets which should be shown but don't
+    // exist yet, and release the ones which shouldn't be shown anymore
+    QHash<Node*, Box*> existing;
+    foreach (Box* b, boxes()) {
+        existing[b->data()] = b;
+    }
+
+    int index = 0;
+    foreach (Node* n, data()->children()) {
+        if (!showsChild(n->name())) {
+            continue;
+        }
+
+        if (!existing.remove(n)) {
+            insertBox(new Box(n, this), index, false);
+        }
+        index++;
+    }
+
+    foreach (Box* b, existing) {
+        releaseBox(b);
+    }
+
+    if (expanded_) {
+        foreach (Property* p, data()->properties()) {
+            if (propertyWidget(p) == NULL) {
+                props_.append(new PropertyWidget(p, this));
+            }
+        }
+    } else {
+        qDeleteAll(props_);
+        props_.clear();
+    }
+
+    if (symbolContainer_ && expanded_ && strip_ == NULL) {
+        strip_ = new SymbolStrip(this);
+    } else if (!expanded_ && strip_ != NULL) {
+        delete strip_;
+        strip_ = NULL;
+    }
+}
+
+void Box::releaseBox(Box *b)
+{
+    // arrow targets are children of the diagram, not of the box, so the
+    // subtree has to be taken apart explicitly
+    foreach (Box* ch, b->boxes()) {
+        b->releaseBox(ch);
+    }
+
+    removeBox(b, false);
+    diagram_->forgetBox(b);
+    delete b;
+}
+
+void Box::discard()
+{
+    foreach (Box* ch, boxes()) {
+        releaseBox(ch);
+    }
+
+    diagram_->forgetBox(this);
+    hide();
+    deleteLater();
+}
+
+Box* Box::anchor() const
+{
+    if (anchor_ == NULL) {
+        DiagramElement* de = parentElement();
+        if (arrowTarget_ || de->parentElement() == NULL) {
+            anchor_ = const_cast<Box*>(this);
+        } else {
+            anchor_ = static_cast<Box*>(de)->anchor();
+        }
+    }
+
+    return anchor_;
+}
+
+void Box::invalidateAnchor()
+{
+    if (anchor_ == NULL) {
+        return;
+    }
+
+    anchor_ = NULL;
+    foreach (Box* b, boxes()) {
+        if (!b->arrowTarget_) {
+            b->invalidateAnchor();
+        }
+    }
+}
+
+void Box::updateAbsolutePosition(const QPoint &origin)
+{
+    absPos_ = origin + pos();
+
+    // arrow targets are placed directly on the diagram
+    foreach (Box* box, boxes()) {
+        box->updateAbsolutePosition(box->isArrowTarget() ? QPoint(0, 0) : absPos_);
+    }
+}
 
-    qp.drawRect(absX(), absY(), width(), height());
+void Box::moveEvent(QMoveEvent *ev)
+{
+    DiagramElement::moveEvent(ev);
+    diagram_->invalidatePositions();
+}
 
+void Box::paintBackground(QPainter &qp, const QRect& clip)
+{
+    QRect r(absX(), absY(), width(), height());
+    if (!r.intersects(clip)) {
+        return;
+    }
+
+    qp.setPen(QPen(Qt::black, 1));
+    qp.setBrush(color_);
+    qp.drawRect(r);
+
+    // arrow targets live in another column, the diagram paints them itself
     foreach (Box* box, boxes()) {
-        box->paintBackground(qp);
+        if (!box->isArrowTarget()) {
+            box->paintBackground(qp, clip);
+        }
     }
 }
 
@@ -309,22 +538,16 @@ void Box::mousePressEvent(QMouseEvent *)
     drag->exec(Qt::MoveAction, Qt::MoveAction);
 }
 
+void Box::mouseDoubleClickEvent(QMouseEvent *)
+{
+    setExpanded(!expanded_);
+}
+
 void Box::dragEnterEvent(QDragEnterEvent *ev)
 {
     DiagramElement::dragEnterEvent(ev);
-    bool accept = false;
-    if (ev->mimeData()->hasFormat("application/x-dnd-visruledprop")) {
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledprop");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-        QString name;
-        stream >> name;
-
-        VisualSchema::Tag tdef = fileConfig(data()->filePath()).tag(data()->name());
 
-        accept = tdef.properties.contains(name);
-    }
-
-    if (accept) {
+    if (acceptsDrop(dragSession(ev))) {
         ev->acceptProposedAction();
     }
 }
@@ -332,62 +555,65 @@ void Box::dragEnterEvent(QDragEnterEvent *ev)
 void Box::dragMoveEvent(QDragMoveEvent *ev)
 {
     DiagramElement::dragMoveEvent(ev);
-    bool accept = false;
-    if (ev->mimeData()->hasFormat("application/x-dnd-visruledprop")) {
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledprop");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-        QString name;
-        stream >> name;
 
-        VisualSchema::Tag tdef = fileConfig(data()->filePath()).tag(data()->name());
-
-        accept = tdef.properties.contains(name);
-    }
-
-    if (accept) {
+    if (acceptsDrop(dragSession(ev))) {
         ev->acceptProposedAction();
     }
 }
 
+bool Box::acceptsDrop(const DragSession &ds) const
+{
+    // properties, and symbols which go to the symbol strip
+    return ds.acceptsProperty || (strip_ != NULL && ds.childTag && SymbolStrip::isSymbol(ds.name));
+}
+
 void Box::dropEvent(QDropEvent *ev)
 {
+    // the base class ends the drag session
+    DragSession ds = dragSession(ev);
     DiagramElement::dropEvent(ev);
-    bool accept = false;
-    if (ev->mimeData()->hasFormat("application/x-dnd-visruledprop")) {
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledprop");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-        QString name;
-        stream >> name;
-
-        VisualSchema::Tag tdef = fileConfig(data()->filePath()).tag(data()->name());
 
-        accept = tdef.properties.contains(name);
-    }
-
-    if (accept) {
+    if (ds.acceptsProperty) {
         ev->accept();
-        QByteArray mdata = ev->mimeData()->data("application/x-dnd-visruledprop");
-        QDataStream stream(&mdata, QIODevice::ReadOnly);
-
-        QString name;
-        stream >> name;
 
-        Property* pr = new Property(name, "");
+        Property* pr = new Property(ds.name, "");
         data()->addProperty(pr);
         PropertyWidget* pw = new PropertyWidget(pr, this);
         actionStack().push(new actions::AddProperty(pw, this));
+    } else if (acceptsDrop(ds)) {
+        ev->accept();
+        strip_->addSymbol(ds.name);
     }
 }
 
+void Box::updateColor()
+{
+    color_ = fileConfig(data()->filePath()).tag(data()->name()).boxColor;
+    const qreal heat = diagram_->heat(data());
+    if (heat >= 0) {
+        color_ = appearance::heatColor(color_, heat);
+    }
+    update();
+}
+
 void Box::updateLayout()
+{
+    if (!layoutDirty_) {
+        layoutDirty_ = true;
+        scheduleLayout(this);
+    }
+}
+
+void Box::applyLayout()
 {
     VisualSchema::Tag tagdef = fileConfig(data()->filePath()).tag(data()->name());
+    updateColor();
 
     if (mainLayout_ != NULL) {
         delete mainLayout_;
     }
 
-    label_->setText(appearance::formatTextBold(tagdef.label));
+    label_->setText(appearance::formatTextBold(expanded_ ? tagdef.label : tagdef.label + " [+]"));
 
     if (tagdef.nesting == "horizontal") {
         mainLayout_ = new QHBoxLayout(this);
@@ -399,6 +625,10 @@ void Box::updateLayout()
     if (!props_.isEmpty()) {
         mainLayout_->addWidget(propsContainer_);
     }
+    if (strip_ != NULL) {
+        mainLayout_->addWidget(strip_);
+        strip_->show();
+    }
 
     foreach (Box* box, boxes()) {
         VisualSchema::Connection cdef = fileConfig(data()->filePath()).connection(data()->name(), box->data()->name());
@@ -417,8 +647,6 @@ void Box::updateLayout()
 
     setMinimumSize(mainLayout_->sizeHint());
     updateGeometry();
-    parentElement()->updateGeometry();
-    parentElement()->updateLayout();
 }
 
 void Box::showContextMenu(const QPoint &where)
@@ -428,17 +656,30 @@ void Box::showContextMenu(const QPoint &where)
     VisualSchema::Tag tdef = fileConfig(data()->filePath()).tag(data()->name());
     QMenu menu(this);
 
+    QAction* toggle = menu.addAction(expanded_ ? "Collapse" : "Expand");
     QAction* del = menu.addAction("Delete");
 
+    QStringList children;
+    foreach (const QString& str, tdef.children) {
+        if (!symbolContainer_ || !SymbolStrip::isSymbol(str)) {
+            children.append(str);
+        }
+    }
+
     QMap<QAction*, QString> centries;
-    if (!tdef.children.isEmpty()) {
+    if (!children.isEmpty()) {
         QMenu* cmenu = menu.addMenu("Add child");
-        foreach(QString str, tdef.children) {
+        foreach(QString str, children) {
             QAction* a = cmenu->addAction(str);
             centries[a] = str;
         }
     }
 
+    QAction* addSymbol = NULL;
+    if (symbolContainer_) {
+        addSymbol = menu.addAction("Add symbol...");
+    }
+
     QMap<QAction*, QString> pentries;
     if (!tdef.properties.isEmpty()) {
         QMenu* pmenu = menu.addMenu("Add property");
@@ -450,13 +691,29 @@ void Box::showContextMenu(const QPoint &where)
 
     QAction* res = menu.exec(pos);
 
-    if (res == del) {
+    // new children and properties have to be visible
+    if (centries.contains(res) || pentries.contains(res) || (res != NULL && res == addSymbol)) {
+        setExpanded(true);
+    }
+
+    if (res == NULL) {
+        return;
+    } else if (res == addSymbol) {
+        strip_->showPicker();
+    } else if (res == toggle) {
+        setExpanded(!expanded_);
+    } else if (res == del) {
+        // the boxes of all the children are torn down under one layout
+        actionStack().beginTransaction();
         actionStack().push(new actions::DeleteBox(this));
+        actionStack().commitTransaction();
     } else if (centries.contains(res)) {
+        actionStack().beginTransaction();
         Node* n = Node::create(centries[res], true, data());
         data()->addChild(n);
         Box* newb = new Box(n, this);
         actionStack().push(new actions::InsertBox(newb, boxes().size(), this));
+        actionStack().commitTransaction();
     } else if (pentries.contains(res)) {
         Property* pr = new Property(pentries[res], "");
         data()->addProperty(pr);
@@ -468,23 +725,135 @@ void Box::showContextMenu(const QPoint &where)
 Diagram::Diagram(Node *data, QWidget *parent)
     : DiagramElement(data, NULL, parent)
     , arrows_()
+    , arrowIndex_()
+    , arrowIndexDirty_(false)
+    , positionsDirty_(true)
     , stack_()
     , selectedBox_(this)
+    , dirtyBoxes_()
+    , layoutScheduled_(false)
+    , layoutSuspended_(false)
+    , heat_()
 {
     setContextMenuPolicy(Qt::CustomContextMenu);
     connect(this, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(showContextMenu(QPoint)));
+    connect(&stack_, SIGNAL(transactionStarted()), this, SLOT(suspendLayout()));
+    connect(&stack_, SIGNAL(transactionFinished()), this, SLOT(resumeLayout()));
+    stack_.setDiagram(this);
     if (data == NULL) {
         return;
     }
 
     foreach (Node* n, data->children()) {
-        addBox(new Box(n, this));
+        addBox(new Box(n, this), false);
     }
     updateLayout();
 }
 
 void Diagram::updateLayout()
 {
+    scheduleLayout(NULL);
+}
+
+void Diagram::scheduleLayout(Box *b)
+{
+    if (b != NULL) {
+        dirtyBoxes_.append(b);
+    }
+
+    if (!layoutScheduled_) {
+        layoutScheduled_ = true;
+        if (!layoutSuspended_) {
+            QTimer::singleShot(0, this, SLOT(flushLayout()));
+        }
+    }
+}
+
+void Diagram::suspendLayout()
+{
+    layoutSuspended_ = true;
+    setUpdatesEnabled(false);
+}
+
+void Diagram::resumeLayout()
+{
+    layoutSuspended_ = false;
+    setUpdatesEnabled(true);
+
+    // everything the transaction changed is laid out in one go
+    if (layoutScheduled_) {
+        flushLayout();
+    }
+}
+
+void Diagram::flushLayout()
+{
+#ifdef VISRULED_PROFILE
+    QElapsedTimer timer;
+    timer.start();
+#endif
+
+    // resumeLayout() flushes once the transaction is over
+    if (layoutSuspended_) {
+        return;
+    }
+
+    layoutScheduled_ = false;
+
+    // A box's size hint depends on its children, so every ancestor of a dirty
+    // box has to be rebuilt too, and always after its children.
+    QList<Box*> pending;
+    foreach (const QPointer<Box>& b, dirtyBoxes_) {
+        if (b.isNull()) {
+            continue;
+        }
+        pending.append(b);
+
+        DiagramElement* de = b->parentElement();
+        while (de != this && de != NULL) {
+            Box* pb = static_cast<Box*>(de);
+            if (pb->isLayoutDirty()) {
+                break;
+            }
+            pb->setLayoutDirty(true);
+            pending.append(pb);
+            de = pb->parentElement();
+        }
+    }
+    dirtyBoxes_.clear();
+
+    QList<QPair<int, Box*> > byDepth;
+    foreach (Box* b, pending) {
+        int depth = 0;
+        for (DiagramElement* de = b->parentElement(); de != this && de != NULL; de = de->parentElement()) {
+            depth++;
+        }
+        byDepth.append(QPair<int, Box*>(-depth, b));
+    }
+    qSort(byDepth);
+
+    for (int i = 0; i<byDepth.size(); i++) {
+        Box* b = byDepth[i].second;
+        b->setLayoutDirty(false);
+        b->applyLayout();
+    }
+
+    layoutColumns();
+
+#ifdef VISRULED_PROFILE
+    qDebug() << "Diagram::flushLayout:" << byDepth.size() << "boxes relaid in" << timer.elapsed() << "ms";
+#endif
+}
+
+void Diagram::layoutColumns()
+{
+    if (arrowIndexDirty_) {
+        rebuildArrowIndex();
+    }
+
+    // boxes may have been reparented without moving
+    positionsDirty_ = true;
+
     QPoint p(0, 0);
     int maxX = 50;
     foreach (Box* box, boxes()) {
@@ -497,7 +866,7 @@ void Diagram::updateLayout()
 
     setMinimumSize(maxX, p.y() + 50);
     updateGeometry();
-    repaint();
+    update();
 }
 
 void Diagram::setArrow(Box *from, Box *to)
@@ -507,6 +876,7 @@ void Diagram::setArrow(Box *from, Box *to)
 
     if (!arrows_.contains(arrow)) {
         arrows_.append(arrow);
+        arrowIndexDirty_ = true;
     }
 }
 
@@ -514,6 +884,7 @@ void Diagram::removeArrow(Box *from, Box *to)
 {
     QPair<Box*, Box*> arrow(from, to);
     arrows_.removeOne(arrow);
+    arrowIndexDirty_ = true;
 }
 
 void Diagram::removeArrows(Box *b)
@@ -522,21 +893,52 @@ void Diagram::removeArrows(Box *b)
         const QPair<Box*, Box*>& bb = arrows_[i];
         if (bb.first->isChildOf(b) || bb.second->isChildOf(b)) {
             arrows_.removeAt(i--);
+            arrowIndexDirty_ = true;
         }
     }
 }
 
+void Diagram::updatePositions()
+{
+    if (!positionsDirty_) {
+        return;
+    }
+
+    foreach (Box* box, boxes()) {
+        box->updateAbsolutePosition(QPoint(0, 0));
+    }
+
+    positionsDirty_ = false;
+}
+
+void Diagram::rebuildArrowIndex()
+{
+    // every arrow goes to the column after the one its source's anchor is in
+    arrowIndex_.clear();
+    for (QList<QPair<Box*, Box*> >::ConstIterator i = arrows_.constBegin(); i != arrows_.constEnd(); i++) {
+        arrowIndex_[i->first->anchor()].append(i->second);
+    }
+
+    arrowIndexDirty_ = false;
+}
+
 void Diagram::paintEvent(QPaintEvent *ev)
 {
     QWidget::paintEvent(ev);
     QPainter painter(this);
     QSize size = minimumSize();
+    const QRect clip = ev->rect();
+
+    updatePositions();
 
     painter.setBrush(Qt::white);
     painter.drawRect(0, 0, size.width(), size.height());
 
     foreach (Box* box, boxes()) {
-        box->paintBackground(painter);
+        box->paintBackground(painter, clip);
+    }
+    for (QList<QPair<Box*, Box*> >::Iterator pair = arrows_.begin(); pair != arrows_.end(); pair++) {
+        pair->second->paintBackground(painter, clip);
     }
 
     painter.setPen(QPen(Qt::black, 1));
@@ -546,6 +948,10 @@ void Diagram::paintEvent(QPaintEvent *ev)
         QPointF from(pair->first->absX() + pair->first->width(), pair->first->absY() + pair->first->height()/2);
         QPointF to(pair->second->absX(), pair->second->absY() + pair->second->height()/2);
 
+        if (!QRectF(from, to).normalized().adjusted(-5, -5, 5, 5).intersects(clip)) {
+            continue;
+        }
+
         double d = sqrt(pow(from.x() - to.x(), 2) + pow(from.y() - to.y(), 2));
 
         double bx = to.x() * (d - 5)/d + from.x() * 5/d;
@@ -584,11 +990,7 @@ QPoint Diagram::layoutBoxes(const QList<Box *> &bl, QPoint start)
         maxWidth = std::max(maxWidth, b->width());
         curY += b->height() + 10;
 
-        for (QList<QPair<Box*, Box*> >::Iterator i = arrows_.begin(); i != arrows_.end(); i++) {
-            if (i->first->isChildOf(b, true)) {
-                nextColumn.append(i->second);
-            }
-        }
+        nextColumn += arrowIndex_.value(b);
     }
 
     QPoint next(start.x() + maxWidth + 50, -1);
@@ -602,6 +1004,12 @@ QPoint Diagram::layoutBoxes(const QList<Box *> &bl, QPoint start)
 
 void Diagram::setData(Node *n)
 {
+#ifdef VISRULED_PROFILE
+    QElapsedTimer timer;
+    timer.start();
+#endif
+
+    clearArrows();
     foreach(Box* b, boxes()) {
         delete b;
     }
@@ -612,9 +1020,14 @@ void Diagram::setData(Node *n)
     }
 
     foreach (Node* n, n->children()) {
-        addBox(new Box(n, this));
+        addBox(new Box(n, this), false);
     }
     DiagramElement::setData(n);
+    updateLayout();
+
+#ifdef VISRULED_PROFILE
+    qDebug() << "Diagram::setData:" << boxes().size() << "top-level boxes built in" << timer.elapsed() << "ms";
+#endif
 }
 
 void Diagram::showContextMenu(const QPoint &where)
@@ -636,24 +1049,65 @@ void Diagram::showContextMenu(const QPoint &where)
     QAction* res = menu.exec(pos);
 
     if (centries.contains(res)) {
+        actionStack().beginTransaction();
         Node* n = Node::create(centries[res], true, data());
         data()->addChild(n);
         Box* b =new Box(n, this);
         actionStack().push(new actions::InsertBox(b, boxes().size(), this));
+        actionStack().commitTransaction();
         updateLayout();
     }
 }
 
+DiagramElement* Diagram::elementFor(Node *n)
+{
+    if (n == NULL) {
+        return NULL;
+    } else if (n == data()) {
+        return this;
+    }
+
+    DiagramElement* de = elementFor(n->parentNode());
+    return de == NULL ? NULL : de->childBox(n);
+}
+
+void Diagram::setHeat(const QHash<Node *, qreal> &heat)
+{
+    heat_ = heat;
+    updateColors(this);
+    update();
+}
+
+void Diagram::updateColors(DiagramElement *de)
+{
+    foreach (Box* b, de->boxes()) {
+        b->updateColor();
+        updateColors(b);
+    }
+}
+
+void Diagram::forgetBox(Box *b)
+{
+    if (selectedBox_ == b) {
+        registerSelection(b->parentElement());
+    }
+}
+
 void Diagram::registerSelection(DiagramElement *de)
 {
     if (selectedBox_ != NULL) {
         selectedBox_->setSelected(false);
     }
 
+    DiagramElement* old = selectedBox_;
     selectedBox_ = de;
     selectedBox_->setSelected();
     resources::mainWindow->updateSidebar();
-    repaint();
+
+    if (old != NULL) {
+        old->update();
+    }
+    selectedBox_->update();
 }
 
 void Diagram::mousePressEvent(QMouseEvent *)
@@ -24,13 +24,18 @@
 #include <QWidget>
 #include <QPaintEvent>
 #include <QList>
+#include <QVector>
+#include <QHash>
 #include <QBoxLayout>
 #include <QLabel>
 #include <QMimeData>
 #include <QDrag>
+#include <QPointer>
+#include <QStringList>
 #include "node.h"
 #include "propertywidget.h"
 #include "action.h"
+#include "symbolstrip.h"
 
 class Diagram;
 class Box;
@@ -57,12 +62,23 @@ public:
     int getInsertPosition(int x, int y) const;
     int indexOf(Box* b) const { return boxes_.indexOf(b); }
 
+    // boxes may only exist for some of the children of data(), these convert
+    // between positions among the boxes and among the child nodes
+    Box* childBox(Node* n) const;
+    int boxIndexFor(Node* n) const;
+    int nodeIndexFor(int boxPos) const;
+
+    virtual bool showsChild(const QString&) const { return true; }
+    virtual bool showsProperties() const { return true; }
+
     virtual int absX() const = 0;
     virtual int absY() const = 0;
 
+    virtual Diagram* diagram() = 0;
     virtual ActionStack& actionStack() = 0;
 
     virtual void updateLayout() = 0;
+    virtual void scheduleLayout(Box* b) = 0;
 
     bool isChildOf(DiagramElement* de, bool noArrow = false) const;
 
@@ -73,11 +89,40 @@ public:
     DiagramElement* parentElement() const { return parent_; }
 
 protected:
+    // what is known about the drag over this element, valid until the drag
+    // leaves or drops
+    struct DragSession
+    {
+        DragSession()
+            : mime(NULL)
+            , name()
+            , childTag(false)
+            , acceptsChild(false)
+            , acceptsProperty(false)
+            , sourceIndex(-1)
+            , horizontal(false)
+            , offsets()
+        {}
+
+        const QMimeData* mime;
+        QString name;
+        bool childTag;
+        bool acceptsChild;
+        bool acceptsProperty;
+        int sourceIndex;
+        bool horizontal;
+        QVector<int> offsets;
+    };
+
     void setParentElement(DiagramElement* de) { parent_ = de; }
 
+    const DragSession& dragSession(const QDropEvent* ev);
+    void endDragSession();
+
     void dropEvent(QDropEvent *ev);
     void dragEnterEvent(QDragEnterEvent *ev);
     void dragMoveEvent(QDragMoveEvent *ev);
+    void dragLeaveEvent(QDragLeaveEvent *ev);
 
     DiagramElement(Node* data, DiagramElement* parentE = NULL, QWidget* parent = NULL)
         : QWidget(parent)
@@ -85,16 +130,21 @@ protected:
         , parent_(parentE)
         , boxes_()
         , selected_(false)
+        , drag_()
     {
         setAcceptDrops(true);
     }
 
 private:
     DiagramElement(const DiagramElement&);
+    QVector<int> boxOffsets(bool horizontal) const;
+    static int insertPosition(const QVector<int>& offsets, int v);
+
     Node* data_;
     DiagramElement* parent_;
     QList<Box*> boxes_;
     bool selected_;
+    DragSession drag_;
 };
 
 class Box : public DiagramElement
@@ -113,15 +163,41 @@ public:
     virtual void insertBox(Box *b, int index, bool repaint = true);
     void addProperty(PropertyWidget* pw);
     void removeProperty(PropertyWidget* pw);
+    PropertyWidget* propertyWidget(Property* p) const;
+
+    // a collapsed box has no property widgets and only has boxes for the
+    // children listed in the schema, the rest is created when expanded
+    bool isExpanded() const { return expanded_; }
+    void setExpanded(bool b);
+
+    // deletes a box already removed from its parent, together with the boxes
+    // of its subtree; the box itself goes once control returns to the event
+    // loop, since it may be the one which triggered the removal
+    void discard();
+    bool showsChild(const QString& name) const;
+    bool showsProperties() const { return expanded_; }
 
-    int absX() const;
-    int absY() const;
+    int absX() const { return absPos_.x(); }
+    int absY() const { return absPos_.y(); }
+    void updateAbsolutePosition(const QPoint& origin);
 
-    void paintBackground(QPainter& qp);
+    void paintBackground(QPainter& qp, const QRect& clip);
+    // the colour of the tag, or its heat if the diagram shows a heatmap
+    void updateColor();
+
+    Diagram* diagram() { return diagram_; }
 
     ActionStack& actionStack() { return parentElement()->actionStack(); }
 
     void updateLayout();
+    void scheduleLayout(Box *b) { parentElement()->scheduleLayout(b); }
+    void applyLayout();
+    bool isLayoutDirty() const { return layoutDirty_; }
+    void setLayoutDirty(bool b) { layoutDirty_ = b; }
+
+    bool isArrowTarget() const { return arrowTarget_; }
+    Box* anchor() const;
+    void invalidateAnchor();
 
     QSize minimumSizeHint() const { return mainLayout_->sizeHint(); }
     QSize sizeHint() const { return mainLayout_->sizeHint(); }
@@ -137,12 +213,28 @@ public slots:
 protected:
     void paintEvent(QPaintEvent *ev);
     void mousePressEvent(QMouseEvent * );
+    void mouseDoubleClickEvent(QMouseEvent *);
+    void moveEvent(QMoveEvent *ev);
 
 private:
+    bool acceptsDrop(const DragSession& ds) const;
+    void syncChildren();
+    void releaseBox(Box* b);
+
+    Diagram* diagram_;
     QLabel* label_;
     QBoxLayout* mainLayout_;
     QWidget* propsContainer_;
     QList<PropertyWidget*> props_;
+    QColor color_;
+    bool layoutDirty_;
+    bool arrowTarget_;
+    mutable Box* anchor_;
+    QPoint absPos_;
+    bool expanded_;
+    QStringList collapsedChildren_;
+    bool symbolContainer_;
+    SymbolStrip* strip_;
 };
 
 class Diagram : public DiagramElement
@@ -154,14 +246,28 @@ public:
     void setArrow(Box* from, Box* to);
     void removeArrow(Box* from, Box* to);
     void removeArrows(Box* b);
-    void clearArrows() { arrows_.clear(); }
+    void clearArrows() { arrows_.clear(); arrowIndexDirty_ = true; }
 
     void setData(Node *n);
 
     int absX() const { return 0; }
     int absY() const { return 0; }
+    void invalidatePositions() { positionsDirty_ = true; }
+
+    Diagram* diagram() { return this; }
+
+    // the element showing n, NULL if there is none (e.g. n is collapsed)
+    DiagramElement* elementFor(Node* n);
+
+    // shades the boxes of the nodes by their heat, see appearance::heatColor;
+    // an empty map turns the heatmap off
+    void setHeat(const QHash<Node*, qreal>& heat);
+    // -1 if n has no heat
+    qreal heat(Node* n) const { return heat_.value(n, -1); }
+    void forgetBox(Box* b);
 
     void updateLayout();
+    void scheduleLayout(Box *b);
 
     void paintEvent(QPaintEvent * ev);
 
@@ -176,12 +282,28 @@ public slots:
 protected:
     void mousePressEvent(QMouseEvent *);
 
+private slots:
+    void flushLayout();
+    void suspendLayout();
+    void resumeLayout();
+
 private:
+    void layoutColumns();
     QPoint layoutBoxes(const QList<Box*>& bl, QPoint start);
+    void rebuildArrowIndex();
+    void updatePositions();
+    void updateColors(DiagramElement* de);
 
     QList<QPair<Box*, Box*> > arrows_;
+    QHash<Box*, QList<Box*> > arrowIndex_;
+    bool arrowIndexDirty_;
+    bool positionsDirty_;
     ActionStack stack_;
     DiagramElement* selectedBox_;
+    QList<QPointer<Box> > dirtyBoxes_;
+    bool layoutScheduled_;
+    bool layoutSuspended_;
+    QHash<Node*, qreal> heat_;
 };
 
 #endif // DIAGRAM_H
@@ -30,7 +30,11 @@ FileTab::FileTab(QWidget *parent, RootNode *root) :
     sections_(),
     fileRoot_(root),
     saved_(true),
-    tools_(fileConfig(root->filePath()).slDictPath(), fileConfig(root->filePath()).tlDictPath(), fileConfig(root->filePath()).biDictPath(), root->filePath())
+    tools_(fileConfig(root->filePath()).slDictPath(), fileConfig(root->filePath()).tlDictPath(), fileConfig(root->filePath()).biDictPath(), root->filePath()),
+    journal_(),
+    interpreter_(root),
+    patterns_(root),
+    analyzer_(&patterns_)
 {
     ui->setupUi(this);
 
@@ -38,6 +42,10 @@ FileTab::FileTab(QWidget *parent, RootNode *root) :
         if (appConfig().tag((*i)->name()).reptype == reptype::TAB) {
             SectionTab* st = new SectionTab(this, *i);
             connect(&(st->actionStack()), SIGNAL(actionPerformed()), this, SLOT(setUnsaved()));
+            connect(&(st->actionStack()), SIGNAL(actionPerformed()), &interpreter_, SLOT(invalidate()));
+            connect(&(st->actionStack()), SIGNAL(actionPerformed()), &patterns_, SLOT(invalidate()));
+            connect(&(st->actionStack()), SIGNAL(actionPerformed()), &analyzer_, SLOT(invalidate()));
+            st->actionStack().setJournal(&journal_, root);
             QString label = appConfig().tag((*i)->name()).label;
             sections_.append(QPair<QString, SectionTab*>(label, st));
             QTabWidget* tw = findChild<QTabWidget*>("sectionsContainer");
@@ -61,6 +69,36 @@ void FileTab::setFilePath(const QString &path)
     setTargetLangDictPath(tl);
     setBilingualDictPath(bl);
     tools_.setTransferRules(path);
+
+    // untitled files get their journal when they are first saved
+    if (path.isEmpty()) {
+        return;
+    } else if (journal_.isOpen()) {
+        journal_.rename(path);
+    } else {
+        journal_.open(path);
+    }
+}
+
+void FileTab::setSaved()
+{
+    saved_ = true;
+
+    // nothing before the save has to be recovered, only the steps the undo
+    // history can still read back are kept
+    QSet<qint64> keep;
+    for (int i = 0; i<sections_.size(); i++) {
+        keep += sections_[i].second->actionStack().journalSteps();
+    }
+
+    QHash<qint64, qint64> moved;
+    if (journal_.compact(keep, moved)) {
+        for (int i = 0; i<sections_.size(); i++) {
+            sections_[i].second->actionStack().moveJournalSteps(moved);
+        }
+    }
+
+    emit saveStateChanged(true);
 }
 
 QString FileTab::fileName() const
@@ -75,6 +113,23 @@ QString FileTab::fileName() const
     return QFileInfo(f).fileName();
 }
 
+void FileTab::showNode(Node *n)
+{
+    Node* section = n;
+    while (section != NULL && section->parentNode() != fileRoot_) {
+        section = section->parentNode();
+    }
+
+    for (int i = 0; i<sections_.size(); i++) {
+        SectionTab* st = sections_[i].second;
+        if (st->sectionRoot() == section) {
+            findChild<QTabWidget*>("sectionsContainer")->setCurrentWidget(st);
+            st->showNode(n);
+            return;
+        }
+    }
+}
+
 void FileTab::on_sectionsContainer_currentChanged()
 {
     emit sectionChanged();
@@ -104,6 +159,8 @@ void FileTab::setSourceLangDictPath(const QString &str)
 {
     fileConfig(fileRoot_->filePath()).setSlDictPath(str);
     tools_.setSlDict(str);
+    // the cat-items are checked against its sdefs
+    analyzer_.invalidate();
 }
 
 void FileTab::setTargetLangDictPath(const QString &str)
@@ -27,6 +27,10 @@
 #include "sectiontab.h"
 #include "tools.h"
 #include "config.h"
+#include "journal.h"
+#include "interpreter.h"
+#include "patternindex.h"
+#include "patternanalyzer.h"
 
 namespace Ui {
 class FileTab;
@@ -50,7 +54,7 @@ public:
     QString fileName() const;
 
     RootNode* rootNode() const { return fileRoot_; }
-    void setRootNode(RootNode* n) { fileRoot_ = n; }
+    void setRootNode(RootNode* n) { fileRoot_ = n; interpreter_.setRoot(n); patterns_.setRoot(n); analyzer_.invalidate(); }
 
     ActionStack* currentActionStack();
 
@@ -67,10 +71,20 @@ public:
     void setBilingualDictPath(const QString& str);
 
     ToolsManager& toolsManager() { return tools_; }
+    // runs the rules as they are in the editor
+    TransferInterpreter& interpreter() { return interpreter_; }
+    PatternIndex& patternIndex() { return patterns_; }
+    PatternAnalyzer& patternAnalyzer() { return analyzer_; }
+
+    // shows n in the section it belongs to
+    void showNode(Node* n);
+
+    // deletes the edit journal, when the file is closed on purpose
+    void discardJournal() { journal_.discard(); }
 
 public slots:
     void setUnsaved() { saved_ = false; emit saveStateChanged(false); }
-    void setSaved() { saved_ = true; emit saveStateChanged(true); }
+    void setSaved();
 
 signals:
     void sectionChanged();
@@ -87,6 +101,10 @@ private:
     bool saved_;
 
     ToolsManager tools_;
+    EditJournal journal_;
+    TransferInterpreter interpreter_;
+    PatternIndex patterns_;
+    PatternAnalyzer analyzer_;
 };
 
 #endif // FILETAB_H
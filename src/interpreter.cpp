@@ -0,0 +1,582 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "interpreter.h"
+#include "patterns.h"
+#include <QtAlgorithms>
+
+namespace {
+bool longerFirst(const QString& a, const QString& b)
+{
+    return a.size() > b.size();
+}
+
+// the position of the first c not escaped with a backslash, from start
+int unescapedIndexOf(const QString& str, QChar c, int start = 0)
+{
+    for (int i = start; i<str.size(); i++) {
+        if (str[i] == '\\') {
+            i++;
+        } else if (str[i] == c) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+}
+
+TransferInterpreter::TransferInterpreter(Node *root, QObject *parent)
+    : QObject(parent)
+    , root_(root)
+    , dirty_(true)
+    , doc_()
+    , cats_()
+    , attrs_()
+    , lists_()
+    , varDefaults_()
+    , macros_()
+    , rules_()
+    , words_()
+    , blanks_()
+    , wordCats_()
+    , vars_()
+    , frame_()
+    , out_()
+    , none_()
+{}
+
+bool TransferInterpreter::run(const QString &input, QString &output, QString *error)
+{
+    if (!prepare(error)) {
+        return false;
+    }
+
+    parseWords(input);
+    wordCats_.clear();
+    foreach (const Word& w, words_) {
+        wordCats_.append(categoriesOf(w));
+    }
+    vars_ = varDefaults_;
+    out_.clear();
+
+    int i = 0;
+    while (i < words_.size()) {
+        out_ += blanks_[i];
+
+        int length = 0;
+        int rule = matchRule(i, length);
+        if (rule == -1) {
+            out_ += "^" + words_[i].tl + "$";
+            i++;
+        } else {
+            applyRule(rule, i, length);
+            i += length;
+        }
+    }
+    out_ += blanks_.last();
+
+    output = out_;
+    return true;
+}
+
+bool TransferInterpreter::prepare(QString *error)
+{
+    if (!dirty_) {
+        return true;
+    }
+
+    cats_.clear();
+    attrs_.clear();
+    lists_.clear();
+    varDefaults_.clear();
+    macros_.clear();
+    rules_.clear();
+
+    if (root_ == NULL) {
+        if (error != NULL) {
+            *error = tr("There are no rules to run");
+        }
+        return false;
+    }
+
+    QString msg;
+    int line = 0;
+    if (!doc_.setContent(root_->toXml(), &msg, &line)) {
+        if (error != NULL) {
+            *error = tr("Can't read the rules: %1 (line %2)").arg(msg).arg(line);
+        }
+        return false;
+    }
+
+    QDomNodeList defs = doc_.elementsByTagName("def-cat");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        QList<CatItem>& items = cats_[def.attribute("n")];
+        for (QDomElement ci = def.firstChildElement("cat-item"); !ci.isNull(); ci = ci.nextSiblingElement("cat-item")) {
+            CatItem item;
+            item.lemma = ci.attribute("lemma");
+            item.tags = ci.attribute("tags").split('.', QString::SkipEmptyParts);
+            items.append(item);
+        }
+    }
+
+    defs = doc_.elementsByTagName("def-attr");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        QStringList& alternatives = attrs_[def.attribute("n")];
+        for (QDomElement ai = def.firstChildElement("attr-item"); !ai.isNull(); ai = ai.nextSiblingElement("attr-item")) {
+            alternatives.append("<" + ai.attribute("tags").split('.').join("><") + ">");
+        }
+        // a longer alternative wins over its prefix, e.g. <m><sp> over <m>
+        qStableSort(alternatives.begin(), alternatives.end(), longerFirst);
+    }
+
+    defs = doc_.elementsByTagName("def-list");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        QStringList& items = lists_[def.attribute("n")];
+        for (QDomElement li = def.firstChildElement("list-item"); !li.isNull(); li = li.nextSiblingElement("list-item")) {
+            items.append(li.attribute("v"));
+        }
+    }
+
+    defs = doc_.elementsByTagName("def-var");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        varDefaults_[def.attribute("n")] = def.attribute("v");
+    }
+
+    defs = doc_.elementsByTagName("def-macro");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        macros_[def.attribute("n")] = def;
+    }
+
+    defs = doc_.elementsByTagName("rule");
+    for (int i = 0; i<defs.size(); i++) {
+        QDomElement def = defs.at(i).toElement();
+        Rule rule;
+        QDomElement pattern = def.firstChildElement("pattern");
+        for (QDomElement pi = pattern.firstChildElement("pattern-item"); !pi.isNull(); pi = pi.nextSiblingElement("pattern-item")) {
+            rule.pattern.append(pi.attribute("n"));
+        }
+        rule.action = def.firstChildElement("action");
+        rules_.append(rule);
+    }
+
+    dirty_ = false;
+    return true;
+}
+
+void TransferInterpreter::parseWords(const QString &input)
+{
+    words_.clear();
+    blanks_.clear();
+
+    QString blank;
+    QString lu;
+    bool inLu = false;
+    bool inSuperblank = false;
+    for (int i = 0; i<input.size(); i++) {
+        const QChar c = input[i];
+        QString& current = inLu ? lu : blank;
+        if (c == '\\' && i+1 < input.size()) {
+            current += c;
+            current += input[++i];
+        } else if (inLu && c == '$') {
+            // only the first translation is used
+            Word w;
+            int slash = unescapedIndexOf(lu, '/');
+            if (slash == -1) {
+                w.sl = w.tl = lu;
+            } else {
+                int next = unescapedIndexOf(lu, '/', slash+1);
+                w.sl = lu.left(slash);
+                w.tl = lu.mid(slash+1, next == -1 ? -1 : next-slash-1);
+            }
+            words_.append(w);
+            blanks_.append(blank);
+            blank.clear();
+            lu.clear();
+            inLu = false;
+        } else if (!inLu && !inSuperblank && c == '^') {
+            inLu = true;
+        } else {
+            if (!inLu && c == '[') {
+                inSuperblank = true;
+            } else if (!inLu && c == ']') {
+                inSuperblank = false;
+            }
+            current += c;
+        }
+    }
+
+    // an unfinished unit is left as it is
+    if (inLu) {
+        blank += "^" + lu;
+    }
+    blanks_.append(blank);
+}
+
+QSet<QString> TransferInterpreter::categoriesOf(const Word &w) const
+{
+    // <n><sg> as n, sg
+    const QString tagStr = part(w.sl, "tags");
+    const QStringList tags = tagStr.mid(1, tagStr.size()-2).split("><", QString::SkipEmptyParts);
+    const QString lem = part(w.sl, "lem");
+
+    QSet<QString> res;
+    for (QHash<QString, QList<CatItem> >::ConstIterator i = cats_.constBegin(); i != cats_.constEnd(); ++i) {
+        foreach (const CatItem& item, i.value()) {
+            if ((item.lemma.isEmpty() || item.lemma.compare(lem, Qt::CaseInsensitive) == 0) && patterns::matchTags(item.tags, tags)) {
+                res.insert(i.key());
+                break;
+            }
+        }
+    }
+
+    return res;
+}
+
+int TransferInterpreter::matchRule(int start, int &length) const
+{
+    int best = -1;
+    length = 0;
+    for (int r = 0; r<rules_.size(); r++) {
+        const QStringList& pattern = rules_[r].pattern;
+        if (pattern.size() <= length || start + pattern.size() > words_.size()) {
+            continue;
+        }
+
+        bool matches = true;
+        for (int k = 0; k<pattern.size() && matches; k++) {
+            matches = wordCats_[start+k].contains(pattern[k]);
+        }
+        if (matches) {
+            best = r;
+            length = pattern.size();
+        }
+    }
+
+    return best;
+}
+
+void TransferInterpreter::applyRule(int rule, int start, int length)
+{
+    frame_.clear();
+    for (int i = 0; i<length; i++) {
+        frame_.append(start + i);
+    }
+
+    exec(rules_[rule].action);
+}
+
+void TransferInterpreter::exec(const QDomElement &e)
+{
+    const QString name = e.tagName();
+    if (name == "let") {
+        assign(firstChild(e, 0), value(firstChild(e, 1)));
+    } else if (name == "append") {
+        vars_[e.attribute("n")] += valueOfChildren(e);
+    } else if (name == "out") {
+        out_ += valueOfChildren(e);
+    } else if (name == "modify-case") {
+        QDomElement container = firstChild(e, 0);
+        assign(container, applyCase(value(container), value(firstChild(e, 1))));
+    } else if (name == "choose") {
+        for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+            if (c.tagName() == "otherwise" || (c.tagName() == "when" && test(c.firstChildElement("test")))) {
+                execChildren(c);
+                return;
+            }
+        }
+    } else if (name == "call-macro") {
+        QVector<int> frame;
+        for (QDomElement p = e.firstChildElement("with-param"); !p.isNull(); p = p.nextSiblingElement("with-param")) {
+            const int pos = p.attribute("pos").toInt();
+            if (pos >= 1 && pos <= frame_.size()) {
+                frame.append(frame_[pos-1]);
+            }
+        }
+
+        const QVector<int> caller = frame_;
+        frame_ = frame;
+        execChildren(macros_.value(e.attribute("n")));
+        frame_ = caller;
+    } else if (name != "test") {
+        // action, the bodies of when and otherwise, and the containers the
+        // editor wraps around statements
+        execChildren(e);
+    }
+}
+
+void TransferInterpreter::execChildren(const QDomElement &e)
+{
+    for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+        exec(c);
+    }
+}
+
+bool TransferInterpreter::test(const QDomElement &e)
+{
+    const QString name = e.tagName();
+    if (name == "test") {
+        return test(e.firstChildElement());
+    } else if (name == "and" || name == "or") {
+        for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+            if (test(c) != (name == "and")) {
+                return name == "or";
+            }
+        }
+        return name == "and";
+    } else if (name == "not") {
+        return !test(e.firstChildElement());
+    }
+
+    const bool caseless = e.attribute("caseless") == "yes";
+    QString a = value(firstChild(e, 0));
+    if (caseless) {
+        a = a.toLower();
+    }
+
+    if (name == "in" || name == "begins-with-list" || name == "ends-with-list") {
+        foreach (QString item, lists_.value(firstChild(e, 1).attribute("n"))) {
+            if (caseless) {
+                item = item.toLower();
+            }
+            if ((name == "in" && a == item) || (name == "begins-with-list" && a.startsWith(item))
+                    || (name == "ends-with-list" && a.endsWith(item))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    QString b = value(firstChild(e, 1));
+    if (caseless) {
+        b = b.toLower();
+    }
+
+    if (name == "equal") {
+        return a == b;
+    } else if (name == "begins-with") {
+        return a.startsWith(b);
+    } else if (name == "ends-with") {
+        return a.endsWith(b);
+    } else if (name == "contains-substring") {
+        return a.contains(b);
+    }
+
+    return false;
+}
+
+QString TransferInterpreter::value(const QDomElement &e)
+{
+    const QString name = e.tagName();
+    if (name == "clip") {
+        QString v = part(side(e), e.attribute("part"));
+        if (e.hasAttribute("link-to") && !v.isEmpty()) {
+            return "<" + e.attribute("link-to") + ">";
+        }
+        return v;
+    } else if (name == "lit") {
+        return e.attribute("v");
+    } else if (name == "lit-tag") {
+        return "<" + e.attribute("v").split('.').join("><") + ">";
+    } else if (name == "var") {
+        return vars_.value(e.attribute("n"));
+    } else if (name == "b") {
+        return e.hasAttribute("pos") ? blankAfter(e.attribute("pos").toInt()) : QString(" ");
+    } else if (name == "lu") {
+        return "^" + valueOfChildren(e) + "$";
+    } else if (name == "mlu") {
+        QStringList lus;
+        for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+            lus.append(valueOfChildren(c));
+        }
+        return "^" + lus.join("+") + "$";
+    } else if (name == "chunk") {
+        QString tags;
+        QString body;
+        for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+            if (c.tagName() == "tags") {
+                for (QDomElement t = c.firstChildElement(); !t.isNull(); t = t.nextSiblingElement()) {
+                    tags += valueOfChildren(t);
+                }
+            } else {
+                body += value(c);
+            }
+        }
+        const QString chunkName = e.hasAttribute("namefrom") ? vars_.value(e.attribute("namefrom")) : e.attribute("name");
+        return "^" + chunkName + tags + "{" + body + "}$";
+    } else if (name == "get-case-from") {
+        const int pos = e.attribute("pos").toInt();
+        const QString from = pos >= 1 && pos <= frame_.size() ? part(words_[frame_[pos-1]].sl, "lem") : QString();
+        return applyCase(valueOfChildren(e), caseOf(from));
+    } else if (name == "case-of") {
+        return caseOf(part(side(e), e.attribute("part")));
+    } else if (name == "concat" || name == "tag") {
+        return valueOfChildren(e);
+    } else if (name == "lu-count") {
+        return QString::number(frame_.size());
+    }
+
+    return QString();
+}
+
+QString TransferInterpreter::valueOfChildren(const QDomElement &e)
+{
+    QString res;
+    for (QDomElement c = e.firstChildElement(); !c.isNull(); c = c.nextSiblingElement()) {
+        res += value(c);
+    }
+
+    return res;
+}
+
+void TransferInterpreter::assign(const QDomElement &container, const QString &v)
+{
+    if (container.tagName() == "var") {
+        vars_[container.attribute("n")] = v;
+    } else if (container.tagName() == "clip") {
+        setPart(side(container), container.attribute("part"), v);
+    }
+}
+
+QString& TransferInterpreter::side(const QDomElement &clip)
+{
+    const int pos = clip.attribute("pos").toInt();
+    if (pos < 1 || pos > frame_.size()) {
+        none_.clear();
+        return none_;
+    }
+
+    Word& w = words_[frame_[pos-1]];
+    return clip.attribute("side") == "sl" ? w.sl : w.tl;
+}
+
+QString TransferInterpreter::part(const QString &lu, const QString &p) const
+{
+    // lemma head, tags, and the queue of multiwords: take<vblex># out
+    int tags = lu.indexOf('<');
+    const int queue = lu.indexOf('#', tags == -1 ? 0 : tags);
+    const int tagsEnd = queue == -1 ? lu.size() : queue;
+    if (tags == -1 || tags > tagsEnd) {
+        tags = tagsEnd;
+    }
+
+    if (p == "whole") {
+        return lu;
+    } else if (p == "lem") {
+        return lu.left(tags) + lu.mid(tagsEnd);
+    } else if (p == "lemh") {
+        return lu.left(tags);
+    } else if (p == "lemq") {
+        return lu.mid(tagsEnd);
+    } else if (p == "tags") {
+        return lu.mid(tags, tagsEnd - tags);
+    }
+
+    // the leftmost alternative of the attribute, the longest at the same place
+    const QString t = lu.mid(tags, tagsEnd - tags);
+    int bestPos = -1;
+    QString best;
+    foreach (const QString& alt, attrs_.value(p)) {
+        int i = t.indexOf(alt);
+        if (i != -1 && (bestPos == -1 || i < bestPos)) {
+            bestPos = i;
+            best = alt;
+        }
+    }
+
+    return best;
+}
+
+void TransferInterpreter::setPart(QString &lu, const QString &p, const QString &v) const
+{
+    int tags = lu.indexOf('<');
+    const int queue = lu.indexOf('#', tags == -1 ? 0 : tags);
+    const int tagsEnd = queue == -1 ? lu.size() : queue;
+    if (tags == -1 || tags > tagsEnd) {
+        tags = tagsEnd;
+    }
+
+    if (p == "whole") {
+        lu = v;
+    } else if (p == "lem") {
+        // the queue is part of the lemma, v replaces both
+        lu.remove(tagsEnd, lu.size() - tagsEnd);
+        lu.replace(0, tags, v);
+    } else if (p == "lemh") {
+        lu.replace(0, tags, v);
+    } else if (p == "lemq") {
+        lu.replace(tagsEnd, lu.size() - tagsEnd, v);
+    } else if (p == "tags") {
+        lu.replace(tags, tagsEnd - tags, v);
+    } else {
+        // an attribute the unit doesn't have is left alone
+        const QString old = part(lu, p);
+        if (!old.isEmpty()) {
+            lu.replace(tags + lu.mid(tags, tagsEnd - tags).indexOf(old), old.size(), v);
+        }
+    }
+}
+
+QString TransferInterpreter::blankAfter(int pos) const
+{
+    if (pos < 1 || pos > frame_.size() || frame_[pos-1] + 1 >= blanks_.size()) {
+        return " ";
+    }
+
+    return blanks_[frame_[pos-1] + 1];
+}
+
+QDomElement TransferInterpreter::firstChild(const QDomElement &e, int index)
+{
+    QDomElement c = e.firstChildElement();
+    for (int i = 0; i<index && !c.isNull(); i++) {
+        c = c.nextSiblingElement();
+    }
+
+    return c;
+}
+
+QString TransferInterpreter::caseOf(const QString &str)
+{
+    if (str.isEmpty() || !str[0].isUpper()) {
+        return "aa";
+    } else if (str.size() > 1 && str[1].isUpper()) {
+        return "AA";
+    }
+
+    return "Aa";
+}
+
+QString TransferInterpreter::applyCase(const QString &str, const QString &casing)
+{
+    if (casing == "AA") {
+        return str.toUpper();
+    } else if (casing == "Aa" && !str.isEmpty()) {
+        return str.left(1).toUpper() + str.mid(1).toLower();
+    }
+
+    return str.toLower();
+}
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QDomDocument>
+#include <QDomElement>
+#include "node.h"
+
+// Runs the transfer rules of a file on lexical units already looked up in the
+// bilingual dictionary (^source<tags>/target<tags>$, as written by lt-proc -b),
+// without compiling them or starting apertium-transfer. The rules are taken
+// from the XML the file would be saved as, so actions mean what they mean in
+// the saved file (see ActionNode::resolveSequence). That form is parsed once
+// and kept until the tree is edited.
+//
+// Rules are applied left to right, always choosing the longest pattern and the
+// first rule among equally long ones; words not matched by any rule are
+// written as their target side. Supported are categories with lemmas and tag
+// wildcards, attributes, lists, variables, macros, let, append, out (lu, mlu,
+// b, chunk), choose/when/otherwise, tests, and modify-case.
+class TransferInterpreter : public QObject
+{
+    Q_OBJECT
+public:
+    TransferInterpreter(Node* root = NULL, QObject* parent = NULL);
+
+    void setRoot(Node* root) { root_ = root; invalidate(); }
+
+    // returns false and sets error if the rules can't be read
+    bool run(const QString& input, QString& output, QString* error = NULL);
+
+public slots:
+    // the tree has changed, the rules are read again on the next run
+    void invalidate() { dirty_ = true; }
+
+private:
+    struct Word
+    {
+        QString sl;
+        QString tl;
+    };
+
+    struct CatItem
+    {
+        QString lemma;
+        // n.* as n, *
+        QStringList tags;
+    };
+
+    struct Rule
+    {
+        QStringList pattern;
+        QDomElement action;
+    };
+
+    bool prepare(QString* error);
+    void parseWords(const QString& input);
+    QSet<QString> categoriesOf(const Word& w) const;
+    int matchRule(int start, int& length) const;
+    void applyRule(int rule, int start, int length);
+
+    void exec(const QDomElement& e);
+    void execChildren(const QDomElement& e);
+    bool test(const QDomElement& e);
+    QString value(const QDomElement& e);
+    QString valueOfChildren(const QDomElement& e);
+    void assign(const QDomElement& container, const QString& v);
+
+    // a lexical unit referred to by a clip
+    QString& side(const QDomElement& clip);
+    QString part(const QString& lu, const QString& part) const;
+    void setPart(QString& lu, const QString& part, const QString& v) const;
+    QString blankAfter(int pos) const;
+
+    static QDomElement firstChild(const QDomElement& e, int index = 0);
+    static QString caseOf(const QString& str);
+    static QString applyCase(const QString& str, const QString& casing);
+
+    Node* root_;
+    bool dirty_;
+    QDomDocument doc_;
+
+    QHash<QString, QList<CatItem> > cats_;
+    // the alternatives of each attribute, as tag strings, longest first
+    QHash<QString, QStringList> attrs_;
+    QHash<QString, QStringList> lists_;
+    QHash<QString, QString> varDefaults_;
+    QHash<QString, QDomElement> macros_;
+    QList<Rule> rules_;
+
+    // state of a run
+    QVector<Word> words_;
+    // blanks_[i] comes before words_[i], the last one ends the text
+    QStringList blanks_;
+    QVector<QSet<QString> > wordCats_;
+    QHash<QString, QString> vars_;
+    // the words the positions of clips refer to in the running rule or macro
+    QVector<int> frame_;
+    QString out_;
+    // what clips with a wrong position refer to
+    QString none_;
+};
+
+#endif // INTERPRETER_H
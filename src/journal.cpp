@@ -0,0 +1,610 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "journal.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QMap>
+#include <QPair>
+#include <QDebug>
+
+namespace journal
+{
+
+QDataStream& operator<<(QDataStream& out, const Op& op)
+{
+    return out << op.type << op.node << op.index << op.index2 << op.name << op.value << op.oldValue << op.data;
+}
+
+QDataStream& operator>>(QDataStream& in, Op& op)
+{
+    return in >> op.type >> op.node >> op.index >> op.index2 >> op.name >> op.value >> op.oldValue >> op.data;
+}
+
+Op nodeOp(Op::Type type, const Node *parent, int pos, const Node *n)
+{
+    Op res;
+    res.type = type;
+    res.node = pathOf(parent);
+    res.index = pos;
+    res.data = serialize(n);
+    return res;
+}
+
+Op moveOp(const Node *parent, int from, int to)
+{
+    Op res;
+    res.type = Op::MOVE_NODE;
+    res.node = pathOf(parent);
+    res.index = from;
+    res.index2 = to;
+    return res;
+}
+
+Op valueOp(const Node *n, const Property *prop, const QString &oldValue, const QString &newValue)
+{
+    Op res;
+    res.type = Op::SET_VALUE;
+    res.node = pathOf(n);
+    res.index = n->properties().indexOf(const_cast<Property*>(prop));
+    res.value = newValue;
+    res.oldValue = oldValue;
+    return res;
+}
+
+Op propertyOp(Op::Type type, const Node *n, const Property *prop, int index)
+{
+    Op res;
+    res.type = type;
+    res.node = pathOf(n);
+    res.index = index;
+    res.name = prop->fullName();
+    res.value = prop->value();
+    return res;
+}
+
+QList<int> pathOf(const Node *n)
+{
+    QList<int> res;
+    for (const Node* p = n; p->parentNode() != NULL; p = p->parentNode()) {
+        res.prepend(p->parentNode()->children().indexOf(const_cast<Node*>(p)));
+    }
+
+    return res;
+}
+
+Node* nodeAt(Node *root, const QList<int> &path)
+{
+    Node* res = root;
+    foreach (int i, path) {
+        if (i < 0 || i >= res->children().size()) {
+            return NULL;
+        }
+        res = res->children()[i];
+    }
+
+    return res;
+}
+
+namespace
+{
+void writeNode(QDataStream& out, const Node* n)
+{
+    out << n->name() << n->cdata() << quint32(n->properties().size());
+    foreach (Property* p, n->properties()) {
+        out << p->fullName() << p->value();
+    }
+
+    out << quint32(n->children().size());
+    foreach (Node* ch, n->children()) {
+        writeNode(out, ch);
+    }
+}
+
+Node* readNode(QDataStream& in)
+{
+    QString name, cdata;
+    quint32 count;
+    in >> name >> cdata >> count;
+    if (in.status() != QDataStream::Ok) {
+        return NULL;
+    }
+
+    Node* res = Node::create(name);
+    res->setCData(cdata);
+    for (quint32 i = 0; i<count && in.status() == QDataStream::Ok; i++) {
+        QString fullName, value;
+        in >> fullName >> value;
+        res->addProperty(new Property(fullName, value));
+    }
+
+    in >> count;
+    for (quint32 i = 0; i<count && in.status() == QDataStream::Ok; i++) {
+        Node* ch = readNode(in);
+        if (ch != NULL) {
+            res->addChild(ch);
+        }
+    }
+
+    return res;
+}
+}
+
+QByteArray serialize(const Node *n)
+{
+    QByteArray res;
+    QDataStream out(&res, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    writeNode(out, n);
+
+    return res;
+}
+
+Node* deserialize(const QByteArray &data)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_0);
+    Node* res = readNode(in);
+    if (in.status() != QDataStream::Ok) {
+        delete res;
+        return NULL;
+    }
+
+    return res;
+}
+
+bool apply(Node *root, const Op &op, bool forward)
+{
+    Node* n = nodeAt(root, op.node);
+    if (n == NULL) {
+        return false;
+    }
+
+    switch (op.type) {
+    case Op::INSERT_NODE:
+    case Op::REMOVE_NODE:
+        if ((op.type == Op::INSERT_NODE) == forward) {
+            if (op.index < 0 || op.index > n->children().size()) {
+                return false;
+            }
+            Node* ch = deserialize(op.data);
+            if (ch == NULL) {
+                return false;
+            }
+            n->insertChild(ch, op.index);
+        } else {
+            if (op.index < 0 || op.index >= n->children().size()) {
+                return false;
+            }
+            Node* ch = n->children()[op.index];
+            n->removeChild(ch);
+            ch->deleteLater();
+        }
+        return true;
+    case Op::MOVE_NODE:
+    {
+        int from = forward ? op.index : op.index2;
+        int to = forward ? op.index2 : op.index;
+        if (from < 0 || from >= n->children().size() || to < 0 || to >= n->children().size()) {
+            return false;
+        }
+        Node* ch = n->children()[from];
+        n->removeChild(ch);
+        n->insertChild(ch, to);
+        return true;
+    }
+    case Op::SET_VALUE:
+        if (op.index < 0 || op.index >= n->properties().size()) {
+            return false;
+        }
+        n->properties()[op.index]->setValue(forward ? op.value : op.oldValue);
+        return true;
+    case Op::ADD_PROPERTY:
+    case Op::REMOVE_PROPERTY:
+        // properties are always added to the end, like the actions do
+        if ((op.type == Op::ADD_PROPERTY) == forward) {
+            n->addProperty(new Property(op.name, op.value));
+        } else {
+            if (op.index < 0 || op.index >= n->properties().size()) {
+                return false;
+            }
+            Property* p = n->properties()[op.index];
+            n->removeProperty(p);
+            p->deleteLater();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+qint64 cost(const Op &op)
+{
+    return sizeof(op) + op.node.size() * sizeof(int) + op.data.size()
+            + (op.name.size() + op.value.size() + op.oldValue.size()) * sizeof(QChar);
+}
+
+}
+
+namespace
+{
+const quint32 JOURNAL_MAGIC = 0x56524a4c;
+const quint16 JOURNAL_VERSION = 1;
+
+enum Record
+{
+    STEP = 1,
+    UNDO,
+    REDO,
+    SAVED
+};
+
+void stampOf(const QString& path, qint64& size, qint64& modified)
+{
+    QFileInfo fi(path);
+    size = fi.exists() ? fi.size() : -1;
+    modified = fi.exists() ? fi.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+struct Contents
+{
+    Contents()
+        : valid(false)
+        , end(0)
+        , savedSize(-1)
+        , savedModified(-1)
+        , steps()
+        , tail()
+    {}
+
+    bool valid;
+    // end of the last complete record, a crash may leave a partial one
+    qint64 end;
+    qint64 savedSize;
+    qint64 savedModified;
+    QMap<qint64, QList<journal::Op> > steps;
+    // records after the last saved marker, as kind and step offset
+    QList<QPair<quint8, qint64> > tail;
+};
+
+Contents readJournal(const QString& path)
+{
+    Contents res;
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return res;
+    }
+
+    QDataStream in(&f);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        return res;
+    }
+
+    res.valid = true;
+    res.end = f.pos();
+    while (!in.atEnd()) {
+        qint64 pos = f.pos();
+        quint8 kind;
+        in >> kind;
+
+        if (kind == STEP) {
+            QList<journal::Op> ops;
+            in >> ops;
+            if (in.status() != QDataStream::Ok) {
+                break;
+            }
+            res.steps.insert(pos, ops);
+            res.tail.append(qMakePair(kind, pos));
+        } else if (kind == UNDO || kind == REDO) {
+            qint64 step;
+            in >> step;
+            if (in.status() != QDataStream::Ok) {
+                break;
+            }
+            res.tail.append(qMakePair(kind, step));
+        } else if (kind == SAVED) {
+            qint64 size, modified;
+            in >> size >> modified;
+            if (in.status() != QDataStream::Ok) {
+                break;
+            }
+            res.savedSize = size;
+            res.savedModified = modified;
+            res.tail.clear();
+        } else {
+            break;
+        }
+
+        res.end = f.pos();
+    }
+
+    return res;
+}
+
+// the journal only applies to the document it was last saved with
+bool matches(const Contents& c, const QString& documentPath)
+{
+    qint64 size, modified;
+    stampOf(documentPath, size, modified);
+    return c.valid && c.savedSize == size && c.savedModified == modified;
+}
+}
+
+EditJournal::EditJournal()
+    : documentPath_()
+    , file_()
+    , out_()
+{
+    out_.setVersion(QDataStream::Qt_5_0);
+}
+
+EditJournal::~EditJournal()
+{
+    if (file_.isOpen()) {
+        file_.close();
+    }
+}
+
+bool EditJournal::open(const QString &documentPath)
+{
+    if (file_.isOpen()) {
+        file_.close();
+    }
+
+    documentPath_ = documentPath;
+    if (documentPath.isEmpty()) {
+        return false;
+    }
+    file_.setFileName(journalPath(documentPath));
+
+    Contents c = readJournal(file_.fileName());
+    if (!file_.open(c.valid ? QIODevice::ReadWrite : QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Can't open edit journal" << file_.fileName();
+        return false;
+    }
+
+    out_.setDevice(&file_);
+    if (c.valid) {
+        file_.resize(c.end);
+        file_.seek(c.end);
+    } else {
+        out_ << JOURNAL_MAGIC << JOURNAL_VERSION;
+        markSaved();
+    }
+
+    return true;
+}
+
+void EditJournal::rename(const QString &documentPath)
+{
+    if (!file_.isOpen()) {
+        open(documentPath);
+        return;
+    }
+
+    QString path = journalPath(documentPath);
+    if (path == file_.fileName()) {
+        documentPath_ = documentPath;
+        return;
+    }
+
+    file_.close();
+    QFile::remove(path);
+    if (!file_.rename(path)) {
+        file_.remove();
+    }
+
+    // continues the renamed journal, so the steps keep their offsets
+    open(documentPath);
+}
+
+void EditJournal::discard()
+{
+    if (file_.isOpen()) {
+        file_.close();
+        file_.remove();
+    }
+}
+
+qint64 EditJournal::writeStep(const QList<journal::Op> &ops)
+{
+    if (!file_.isOpen()) {
+        return -1;
+    }
+
+    qint64 res = file_.pos();
+    out_ << quint8(STEP) << ops;
+    file_.flush();
+
+    return out_.status() == QDataStream::Ok ? res : -1;
+}
+
+void EditJournal::writeUndo(qint64 step)
+{
+    writeRecord(UNDO, step);
+}
+
+void EditJournal::writeRedo(qint64 step)
+{
+    writeRecord(REDO, step);
+}
+
+void EditJournal::markSaved()
+{
+    if (!file_.isOpen()) {
+        return;
+    }
+
+    qint64 size, modified;
+    stampOf(documentPath_, size, modified);
+    out_ << quint8(SAVED) << size << modified;
+    file_.flush();
+}
+
+bool EditJournal::compact(const QSet<qint64> &keep, QHash<qint64, qint64> &moved)
+{
+    moved.clear();
+    if (!file_.isOpen()) {
+        return false;
+    }
+
+    // the kept steps are copied in their original order, so the offsets grow
+    // the same way
+    QList<qint64> steps = keep.toList();
+    qSort(steps);
+
+    QFile f(file_.fileName() + ".new");
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        markSaved();
+        return false;
+    }
+
+    QDataStream out(&f);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << JOURNAL_MAGIC << JOURNAL_VERSION;
+    foreach (qint64 step, steps) {
+        if (step < 0) {
+            continue;
+        }
+        moved[step] = f.pos();
+        out << quint8(STEP) << readStep(step);
+    }
+
+    qint64 size, modified;
+    stampOf(documentPath_, size, modified);
+    out << quint8(SAVED) << size << modified;
+    f.close();
+
+    if (out.status() != QDataStream::Ok) {
+        f.remove();
+        moved.clear();
+        markSaved();
+        return false;
+    }
+
+    // the old journal is kept until the new one is in place, the offsets
+    // held by the undo history stay valid if anything fails
+    const QString path = file_.fileName();
+    file_.close();
+    QFile::remove(path + ".old");
+    const bool replaced = QFile::rename(path, path + ".old") && f.rename(path);
+    if (replaced) {
+        QFile::remove(path + ".old");
+    } else {
+        f.remove();
+        QFile::rename(path + ".old", path);
+        moved.clear();
+    }
+
+    if (file_.open(QIODevice::ReadWrite)) {
+        file_.seek(file_.size());
+        out_.setDevice(&file_);
+        if (!replaced) {
+            markSaved();
+        }
+    }
+
+    return replaced;
+}
+
+void EditJournal::writeRecord(quint8 kind, qint64 step)
+{
+    if (!file_.isOpen() || step < 0) {
+        return;
+    }
+
+    out_ << kind << step;
+    file_.flush();
+}
+
+QList<journal::Op> EditJournal::readStep(qint64 step) const
+{
+    QList<journal::Op> res;
+
+    QFile f(file_.fileName());
+    if (step < 0 || !f.open(QIODevice::ReadOnly) || !f.seek(step)) {
+        return res;
+    }
+
+    QDataStream in(&f);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint8 kind;
+    in >> kind;
+    if (kind != STEP) {
+        return res;
+    }
+
+    in >> res;
+    if (in.status() != QDataStream::Ok) {
+        res.clear();
+    }
+
+    return res;
+}
+
+QString EditJournal::journalPath(const QString &documentPath)
+{
+    QFileInfo fi(documentPath);
+    return fi.dir().filePath("." + fi.fileName() + ".journal");
+}
+
+bool EditJournal::hasRecoverableEdits(const QString &documentPath)
+{
+    Contents c = readJournal(journalPath(documentPath));
+    return matches(c, documentPath) && !c.tail.isEmpty();
+}
+
+bool EditJournal::replay(const QString &documentPath, Node *root)
+{
+    Contents c = readJournal(journalPath(documentPath));
+    if (!matches(c, documentPath)) {
+        return false;
+    }
+
+    int applied = 0;
+    typedef QPair<quint8, qint64> Entry;
+    foreach (const Entry& e, c.tail) {
+        const QList<journal::Op> ops = c.steps.value(e.second);
+        const bool forward = e.first != UNDO;
+        bool ok = true;
+        for (int i = 0; i<ops.size() && ok; i++) {
+            ok = journal::apply(root, ops[forward ? i : ops.size() - 1 - i], forward);
+        }
+
+        if (!ok) {
+            qWarning() << "Edit journal doesn't match" << documentPath << ", replay stopped";
+            break;
+        }
+        applied++;
+    }
+
+    return applied > 0;
+}
+
+void EditJournal::discard(const QString &documentPath)
+{
+    QFile::remove(journalPath(documentPath));
+}
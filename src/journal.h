@@ -0,0 +1,143 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QString>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QByteArray>
+#include <QFile>
+#include <QDataStream>
+#include "node.h"
+
+namespace journal
+{
+
+// A single change of the node tree. Nodes are addressed by their child index
+// path from the root of the file, so operations stay valid across sessions,
+// and every operation carries what is needed to revert it.
+struct Op
+{
+    enum Type {
+        INSERT_NODE,    // node: parent, index: position, data: the subtree
+        REMOVE_NODE,    // same as INSERT_NODE
+        MOVE_NODE,      // node: parent, index: old position, index2: new position
+        SET_VALUE,      // node, index: property, value and oldValue
+        ADD_PROPERTY,   // node, index: property after adding, name and value
+        REMOVE_PROPERTY // node, index: property before removal, name and value
+    };
+
+    Op()
+        : type(SET_VALUE)
+        , node()
+        , index(0)
+        , index2(0)
+        , name()
+        , value()
+        , oldValue()
+        , data()
+    {}
+
+    quint8 type;
+    QList<int> node;
+    qint32 index;
+    qint32 index2;
+    QString name;
+    QString value;
+    QString oldValue;
+    QByteArray data;
+};
+
+QDataStream& operator<<(QDataStream& out, const Op& op);
+QDataStream& operator>>(QDataStream& in, Op& op);
+
+Op nodeOp(Op::Type type, const Node* parent, int pos, const Node* n);
+Op moveOp(const Node* parent, int from, int to);
+Op valueOp(const Node* n, const Property* prop, const QString& oldValue, const QString& newValue);
+Op propertyOp(Op::Type type, const Node* n, const Property* prop, int index);
+
+QList<int> pathOf(const Node* n);
+Node* nodeAt(Node* root, const QList<int>& path);
+
+QByteArray serialize(const Node* n);
+Node* deserialize(const QByteArray& data);
+
+// applies the operation (or reverts it if forward is false) on the model
+// only, returns false if it doesn't fit the tree
+bool apply(Node* root, const Op& op, bool forward);
+
+qint64 cost(const Op& op);
+
+}
+
+// Append-only log of the edits of a document, kept next to it. Each undo
+// step is written as a step record; undoing and redoing it only refers back
+// to it, saving writes a marker with the size and time of the saved file.
+// After a crash the records after the last marker can be replayed on top of
+// the document, and the steps double as undo history that doesn't fit in
+// memory.
+class EditJournal
+{
+public:
+    EditJournal();
+    ~EditJournal();
+
+    // continues an existing journal of the document or starts a new one;
+    // documents without a path (not saved yet) have none
+    bool open(const QString& documentPath);
+    bool isOpen() const { return file_.isOpen(); }
+    // follows the document to a new path
+    void rename(const QString& documentPath);
+    // closes and deletes the journal
+    void discard();
+
+    // returns the offset of the step, -1 if it couldn't be written
+    qint64 writeStep(const QList<journal::Op>& ops);
+    void writeUndo(qint64 step);
+    void writeRedo(qint64 step);
+    void markSaved();
+    // Marks the document saved and drops every record but the steps in keep,
+    // which are still referenced by undo history. moved is set to the new
+    // offsets of the kept steps; returns false if the journal couldn't be
+    // rewritten, the saved marker is appended then.
+    bool compact(const QSet<qint64>& keep, QHash<qint64, qint64>& moved);
+
+    QList<journal::Op> readStep(qint64 step) const;
+
+    static QString journalPath(const QString& documentPath);
+    static bool hasRecoverableEdits(const QString& documentPath);
+    // applies the unsaved edits of the journal on root, the freshly loaded
+    // document, returns false if nothing could be applied
+    static bool replay(const QString& documentPath, Node* root);
+    static void discard(const QString& documentPath);
+
+private:
+    EditJournal(const EditJournal&);
+    void writeRecord(quint8 kind, qint64 step);
+
+    QString documentPath_;
+    QFile file_;
+    QDataStream out_;
+};
+
+#endif // JOURNAL_H
@@ -25,9 +25,26 @@
 #include "resources.h"
 #include "diagram.h"
 #include "sidebar.h"
+#include "corpus.h"
+#include "patternindex.h"
 
 int main(int argc, char *argv[])
 {
+    // regression testing without the GUI, e.g. before a commit
+    for (int i = 1; i<argc; i++) {
+        if (QString(argv[i]) == "--corpus") {
+            QCoreApplication a(argc, argv);
+            return runCorpusHeadless(a.arguments());
+        }
+#ifdef VISRULED_PROFILE
+        if (QString(argv[i]) == "--benchmark-patterns") {
+            QCoreApplication a(argc, argv);
+            PatternIndex::benchmark(10000, 10000);
+            return 0;
+        }
+#endif
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
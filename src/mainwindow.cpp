@@ -24,6 +24,7 @@
 #include <QXmlInputSource>
 #include <QCloseEvent>
 #include <QMessageBox>
+#include <QInputDialog>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
@@ -36,6 +37,9 @@ MainWindow::MainWindow(QWidget *parent) :
     newFileDialog_(this),
     settingsDialog_(this),
     testDialog_(this),
+    profileDialog_(this),
+    patternDialog_(this),
+    lastMatchInput_(),
     stack_(NULL),
     files_(NULL),
     ui(new Ui::MainWindow)
@@ -63,13 +67,35 @@ void MainWindow::on_actionOpen_triggered()
         return;
     }
 
-    FileTab* ft = new FileTab(this, readXmlIntoNode(fileName));
+    RootNode* root = readXmlIntoNode(fileName);
+
+    // a journal left behind means the editor didn't exit properly
+    bool recovered = false;
+    if (EditJournal::hasRecoverableEdits(fileName)) {
+        QMessageBox msg(this);
+        msg.setIcon(QMessageBox::Question);
+        msg.setText(tr("This file has unsaved changes from a previous session."));
+        msg.setInformativeText(tr("Do you want to recover them?"));
+        msg.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+        if (msg.exec() == QMessageBox::Yes) {
+            recovered = EditJournal::replay(fileName, root);
+        }
+    }
+    if (!recovered) {
+        EditJournal::discard(fileName);
+    }
+
+    FileTab* ft = new FileTab(this, root);
 
     connect(ft, SIGNAL(sectionChanged()), this, SLOT(updateActionStack()));
     connect(ft, SIGNAL(sectionChanged()), this, SLOT(updateSidebar()));
     connect(ft, SIGNAL(saveStateChanged(bool)), this, SLOT(updateFileTabLabels()));
+    connect(&ft->toolsManager(), SIGNAL(compileStepFinished(int)), this, SLOT(compileStepFinished(int)));
     connect(&ft->toolsManager(), SIGNAL(compileFinished(bool)), this, SLOT(compileFinished(bool)));
     ft->setFilePath(fileName);
+    if (recovered) {
+        ft->setUnsaved();
+    }
     files_->addTab(ft, ft->fileName());
     files_->setCurrentIndex(files_->count() - 1);
 }
@@ -133,9 +159,60 @@ void MainWindow::on_actionTest_triggered()
 
     FileTab* ft = tab(files_->currentIndex());
     testDialog_.setTools(&ft->toolsManager());
+    testDialog_.setInterpreter(&ft->interpreter());
     testDialog_.show();
 }
 
+void MainWindow::on_actionProfile_triggered()
+{
+    if (files_->currentIndex() == -1) {
+        return;
+    }
+
+    profileDialog_.setFile(tab(files_->currentIndex()));
+    profileDialog_.show();
+}
+
+void MainWindow::on_actionMatchRule_triggered()
+{
+    if (files_->currentIndex() == -1) {
+        return;
+    }
+
+    bool ok;
+    QString input = QInputDialog::getText(this, tr("Find matching rule"),
+                                          tr("Lexical units, e.g. ^the<det><def><sp>$ ^cat<n><sg>$:"),
+                                          QLineEdit::Normal, lastMatchInput_, &ok);
+    if (!ok || input.trimmed().isEmpty()) {
+        return;
+    }
+    lastMatchInput_ = input;
+
+    FileTab* ft = tab(files_->currentIndex());
+    int length;
+    Node* rule = ft->patternIndex().match(input, &length);
+
+    QStatusBar* sb = findChild<QStatusBar*>("statusBar");
+    if (rule == NULL) {
+        sb->showMessage(tr("No rule matches"), 5000);
+        return;
+    }
+
+    ft->showNode(rule);
+    sb->showMessage(tr("Rule %1 matches %n word(s)", "", length)
+                    .arg(ft->patternIndex().position(rule) + 1), 10000);
+}
+
+void MainWindow::on_actionPatternProblems_triggered()
+{
+    if (files_->currentIndex() == -1) {
+        return;
+    }
+
+    patternDialog_.setFile(tab(files_->currentIndex()));
+    patternDialog_.show();
+}
+
 void MainWindow::updateUndoRedo()
 {
     QAction* undo = findChild<QAction*>("actionUndo");
@@ -188,6 +265,7 @@ void MainWindow::createNewFile()
     ft->setUnsaved();
     connect(ft, SIGNAL(sectionChanged()), this, SLOT(updateActionStack()));
     connect(ft, SIGNAL(saveStateChanged(bool)), this, SLOT(updateFileTabLabels()));
+    connect(&ft->toolsManager(), SIGNAL(compileStepFinished(int)), this, SLOT(compileStepFinished(int)));
     connect(&ft->toolsManager(), SIGNAL(compileFinished(bool)), this, SLOT(compileFinished(bool)));
     ft->setFilePath("");
     files_->addTab(ft, ft->fileName() + "*");
@@ -195,14 +273,57 @@ void MainWindow::createNewFile()
     updateSidebar();
 }
 
+void MainWindow::compileStepFinished(int step)
+{
+    ToolsManager* tm = qobject_cast<ToolsManager*>(sender());
+    const ToolsManager::CompileStep& s = tm->compileSteps()[step];
+    if (s.state != ToolsManager::CompileStep::SUCCEEDED) {
+        return;
+    }
+
+    int done = 0;
+    foreach (const ToolsManager::CompileStep& other, tm->compileSteps()) {
+        if (other.state == ToolsManager::CompileStep::SUCCEEDED || other.state == ToolsManager::CompileStep::UP_TO_DATE) {
+            done++;
+        }
+    }
+
+    QStatusBar* sb = findChild<QStatusBar*>("statusBar");
+    sb->showMessage(tr("Compiling: %1 done in %2 s (%3/%4)")
+                    .arg(s.name).arg(s.msecs / 1000.0, 0, 'f', 1)
+                    .arg(done).arg(tm->compileSteps().size()));
+}
+
 void MainWindow::compileFinished(bool successful)
 {
+    ToolsManager* tm = qobject_cast<ToolsManager*>(sender());
     QStatusBar* sb = findChild<QStatusBar*>("statusBar");
-    const QString msg = successful
-            ? tr("Compilation successful")
-            : tr("Compilation failed");
 
-    sb->showMessage(msg, 5000);
+    if (!successful) {
+        sb->showMessage(tr("Compilation failed"), 5000);
+        foreach (const ToolsManager::CompileStep& s, tm->compileSteps()) {
+            if (s.state == ToolsManager::CompileStep::FAILED) {
+                QMessageBox msg(this);
+                msg.setIcon(QMessageBox::Critical);
+                msg.setText(tr("Compilation failed: %1").arg(s.name));
+                msg.setInformativeText(s.program + " " + s.args.join(" "));
+                msg.setDetailedText(s.errors);
+                msg.exec();
+                break;
+            }
+        }
+        return;
+    }
+
+    QStringList times;
+    foreach (const ToolsManager::CompileStep& s, tm->compileSteps()) {
+        if (s.state == ToolsManager::CompileStep::UP_TO_DATE) {
+            times.append(tr("%1: up to date").arg(s.name));
+        } else {
+            times.append(tr("%1: %2 s").arg(s.name).arg(s.msecs / 1000.0, 0, 'f', 1));
+        }
+    }
+    sb->showMessage(tr("Compilation successful (%1)").arg(times.join(", ")), 10000);
 }
 
 void MainWindow::updateFileTabLabels()
@@ -220,13 +341,13 @@ void MainWindow::updateSidebar()
     FileTab* ft = tab(files_->currentIndex());
     SectionTab* st = ft->currentSection();
 
-    if (st->selectedBox() == NULL) {
+    if (st->selectedNode() == NULL) {
         boxbar()->clearItems();
         propertybar()->clearItems();
         return;
     }
 
-    VisualSchema::Tag tdef = fileConfig(ft->filePath()).tag(st->selectedBox()->data()->name());
+    VisualSchema::Tag tdef = fileConfig(ft->filePath()).tag(st->selectedNode()->name());
     boxbar()->clearItems();
     foreach (QString str, tdef.children) {
         VisualSchema::Tag cdef = fileConfig(ft->filePath()).tag(str);
@@ -253,6 +374,10 @@ void MainWindow::updateSettings()
     appConfig().setLtCompPath(settingsDialog_.ltComp());
     appConfig().setLtProcPath(settingsDialog_.ltProc());
     appConfig().setApertiumPreprocTransPath(settingsDialog_.apertiumPreprocTrans());
+    appConfig().setToolJobs(settingsDialog_.toolJobs());
+    appConfig().setUndoLimit(settingsDialog_.undoLimit());
+    appConfig().setUndoMemoryLimit(settingsDialog_.undoMemoryLimit());
+    appConfig().setUndoMergeInterval(settingsDialog_.undoMergeInterval());
 }
 
 void MainWindow::closeEvent(QCloseEvent *ev)
@@ -262,42 +387,58 @@ void MainWindow::closeEvent(QCloseEvent *ev)
     }
 }
 
-void MainWindow::saveFile(int index)
+bool MainWindow::saveFile(int index)
 {
     FileTab* ft = tab(index);
 
-    if (!ft->filePath().isEmpty()) {
-        QFile dst(ft->filePath());
-        dst.open(QIODevice::WriteOnly | QIODevice::Text);
-        QTextStream out(&dst);
+    if (ft->filePath().isEmpty()) {
+        return saveFileAs(index);
+    }
 
-        out << ft->rootNode()->toXml();
-        out.flush();
-        dst.close();
-        ft->setSaved();
-    } else {
-        saveFileAs(index);
+    // the journal is only dropped once the file is really written
+    if (!writeFile(ft, ft->filePath())) {
+        return false;
     }
+    ft->setSaved();
+    return true;
 }
 
-void MainWindow::saveFileAs(int index)
+bool MainWindow::saveFileAs(int index)
 {
     FileTab* ft =tab(index);
 
     QString path = QFileDialog::getSaveFileName(this, tr("Save as"), "", tr("Apertium transfer rules (*.t1x *.t2x *.t3x)"));
-    if (path.isEmpty()) {
-        return;
+    if (path.isEmpty() || !writeFile(ft, path)) {
+        return false;
     }
 
-    QFile dst(path);
-    dst.open(QIODevice::WriteOnly | QIODevice::Text);
-    QTextStream out(&dst);
-
-    out << ft->rootNode()->toXml();
+    ft->setFilePath(path);
     ft->setSaved();
+    files_->setTabText(index, ft->fileName());
+    return true;
+}
 
-    ft->setFilePath(path);
-    files_->setTabText(files_->currentIndex(), ft->fileName());
+bool MainWindow::writeFile(FileTab *ft, const QString &path)
+{
+    QFile dst(path);
+    bool ok = dst.open(QIODevice::WriteOnly | QIODevice::Text);
+    if (ok) {
+        QTextStream out(&dst);
+        out << ft->rootNode()->toXml();
+        out.flush();
+        ok = out.status() == QTextStream::Ok;
+        dst.close();
+        ok = ok && dst.error() == QFile::NoError;
+    }
+
+    if (!ok) {
+        QMessageBox msg(this);
+        msg.setIcon(QMessageBox::Critical);
+        msg.setText(tr("Can't save %1").arg(path));
+        msg.setInformativeText(dst.errorString());
+        msg.exec();
+    }
+    return ok;
 }
 
 bool MainWindow::closeFile(int index)
@@ -305,6 +446,7 @@ bool MainWindow::closeFile(int index)
     FileTab* ft = tab(index);
 
     if (ft->isSaved()) {
+        ft->discardJournal();
         files_->removeTab(index);
         return true;
     }
@@ -319,8 +461,11 @@ bool MainWindow::closeFile(int index)
 
     switch (res) {
     case QMessageBox::Save:
-        saveFile(index);
+        if (!saveFile(index)) {
+            return false;
+        }
     case QMessageBox::Discard:
+        ft->discardJournal();
         files_->removeTab(index);
         return true;
     case QMessageBox::Cancel:
@@ -340,7 +485,7 @@ bool MainWindow::closeAllFiles()
     }
 
     if (!needConfirm) {
-        while (files_->count() > 0) { files_->removeTab(0); }
+        while (files_->count() > 0) { tab(0)->discardJournal(); files_->removeTab(0); }
         return true;
     }
 
@@ -354,9 +499,13 @@ bool MainWindow::closeAllFiles()
 
     switch (res) {
     case QMessageBox::SaveAll:
-        for (int i = 0; i<files_->count(); i++) { saveFile(i); }
+        for (int i = 0; i<files_->count(); i++) {
+            if (!tab(i)->isSaved() && !saveFile(i)) {
+                return false;
+            }
+        }
     case QMessageBox::Discard:
-        while (files_->count() > 0) { files_->removeTab(0); }
+        while (files_->count() > 0) { tab(0)->discardJournal(); files_->removeTab(0); }
         return true;
     case QMessageBox::Cancel:
     default:
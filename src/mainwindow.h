@@ -28,6 +28,8 @@
 #include "newfiledialog.h"
 #include "settingsdialog.h"
 #include "testdialog.h"
+#include "profiledialog.h"
+#include "patterndialog.h"
 #include "sidebar.h"
 
 class ActionStack;
@@ -60,6 +62,9 @@ public slots:
     void on_actionSettings_triggered();
     void on_actionCompile_triggered();
     void on_actionTest_triggered();
+    void on_actionProfile_triggered();
+    void on_actionMatchRule_triggered();
+    void on_actionPatternProblems_triggered();
 
     void updateUndoRedo();
     void updateActionStack();
@@ -74,17 +79,24 @@ private slots:
     void createNewFile();
     bool closeFile(int index);
     bool closeAllFiles();
-    void saveFile(int index);
-    void saveFileAs(int index);
+    // return false if the file wasn't saved
+    bool saveFile(int index);
+    bool saveFileAs(int index);
+    void compileStepFinished(int step);
     void compileFinished(bool successful);
 
 
 private:
     FileTab* tab(int index) const { return static_cast<FileTab*>(files_->widget(index)); }
+    // writes the rules of ft to path, tells the user if it fails
+    bool writeFile(FileTab* ft, const QString& path);
 
     NewFileDialog newFileDialog_;
     SettingsDialog settingsDialog_;
     TestDialog testDialog_;
+    ProfileDialog profileDialog_;
+    PatternDialog patternDialog_;
+    QString lastMatchInput_;
     ActionStack* stack_;
     QTabWidget* files_;
 
@@ -0,0 +1,321 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "patternanalyzer.h"
+#include "config.h"
+#include "patterns.h"
+#include <QtConcurrentRun>
+#include <QPair>
+
+#ifdef VISRULED_PROFILE
+#include <QDebug>
+#endif
+
+namespace
+{
+QString itemKey(const patterns::CatItem& item)
+{
+    return item.lemma + "<" + item.tags.join("><") + ">";
+}
+
+bool coversItem(const patterns::CatItem& a, const patterns::CatItem& b)
+{
+    return (a.lemma.isEmpty() || a.lemma.compare(b.lemma, Qt::CaseInsensitive) == 0)
+            && patterns::coversTags(a.tags, b.tags);
+}
+}
+
+namespace patternanalysis
+{
+
+Result compute(const Snapshot &snapshot, const Cache &cache)
+{
+    Result res;
+    res.cache = cache;
+    if (res.cache.covers.size() > 100000) {
+        res.cache.covers.clear();
+    }
+
+    // the items of each category that can match something; a category is
+    // described by these only, so the cache stays valid when an unmatchable
+    // item is changed. The items are grouped by category name, as PatternIndex
+    // matches them.
+    const PatternIndex::Snapshot& index = snapshot.index;
+    QHash<QString, QList<patterns::CatItem> > live;
+    QHash<QString, QStringList> keys;
+    for (int i = 0; i<index.items.size(); i++) {
+        const patterns::CatItem& item = index.items[i];
+        QStringList unknown;
+        if (!snapshot.sdefs.isEmpty()) {
+            foreach (const QString& tag, item.tags) {
+                if (tag != "*" && !snapshot.sdefs.contains(tag)) {
+                    unknown.append(tag);
+                }
+            }
+        }
+
+        if (unknown.isEmpty()) {
+            live[item.cat].append(item);
+            keys[item.cat].append(itemKey(item));
+        } else {
+            DeadItem dead;
+            dead.item = i;
+            dead.unknownTags = unknown;
+            res.items.append(dead);
+        }
+    }
+
+    QHash<QString, QString> signatures;
+    for (QHash<QString, QStringList>::ConstIterator it = keys.constBegin(); it != keys.constEnd(); ++it) {
+        signatures[it.key()] = it.value().join("|");
+    }
+
+    // covers[(a, b)]: every word in category b is in category a as well; only
+    // asked for the categories met on the walks
+    QHash<QPair<QString, QString>, bool> covers;
+    for (int r = 0; r<index.rules.size(); r++) {
+        const QStringList pattern = index.patterns.value(index.rules[r]);
+        QString deadCategory;
+        bool dead = false;
+        foreach (const QString& name, pattern) {
+            if (live.value(name).isEmpty()) {
+                dead = true;
+                deadCategory = name;
+                break;
+            }
+        }
+
+        if (dead) {
+            ShadowedRule sr;
+            sr.rule = r;
+            sr.by = -1;
+            sr.category = deadCategory;
+            res.rules.append(sr);
+            continue;
+        } else if (pattern.isEmpty()) {
+            continue;
+        }
+
+        // the rules that can't match are in the trie too, but their
+        // categories cover nothing, so they are never reached
+        QList<int> current;
+        current.append(0);
+        foreach (const QString& b, pattern) {
+            QList<int> next;
+            foreach (int s, current) {
+                const QHash<QString, int>& edges = index.states[s].next;
+                for (QHash<QString, int>::ConstIterator it = edges.constBegin(); it != edges.constEnd(); ++it) {
+                    const QString& a = it.key();
+                    QPair<QString, QString> pair(a, b);
+                    QHash<QPair<QString, QString>, bool>::ConstIterator known = covers.constFind(pair);
+                    bool c;
+                    if (known != covers.constEnd()) {
+                        c = known.value();
+                    } else if (a == b) {
+                        c = true;
+                        covers[pair] = c;
+                    } else {
+                        const QString key = signatures.value(a) + "\n" + signatures.value(b);
+                        QHash<QString, bool>::ConstIterator cached = res.cache.covers.constFind(key);
+                        if (cached != res.cache.covers.constEnd()) {
+                            c = cached.value();
+                        } else {
+                            const QList<patterns::CatItem> as = live.value(a);
+                            c = true;
+                            foreach (const patterns::CatItem& y, live.value(b)) {
+                                bool found = false;
+                                foreach (const patterns::CatItem& x, as) {
+                                    if (coversItem(x, y)) {
+                                        found = true;
+                                        break;
+                                    }
+                                }
+                                if (!found) {
+                                    c = false;
+                                    break;
+                                }
+                            }
+                            res.cache.covers[key] = c;
+                        }
+                        covers[pair] = c;
+                    }
+
+                    if (c) {
+                        next.append(it.value());
+                    }
+                }
+            }
+            current = next;
+        }
+
+        // a longer pattern doesn't shadow the rule, the input may end after
+        // the words matched by it; among equally long ones the first rule wins
+        int by = -1;
+        foreach (int s, current) {
+            foreach (Node* other, index.states[s].rules) {
+                const int p = index.positions.value(other, -1);
+                if (p != -1 && p < r && (by == -1 || p < by)) {
+                    by = p;
+                }
+            }
+        }
+
+        if (by != -1) {
+            ShadowedRule sr;
+            sr.rule = r;
+            sr.by = by;
+            res.rules.append(sr);
+        }
+    }
+
+    return res;
+}
+
+}
+
+PatternAnalyzer::PatternAnalyzer(PatternIndex *index, QObject *parent)
+    : QObject(parent)
+    , index_(index)
+    , timer_()
+    , watcher_()
+    , running_(false)
+    , stale_(false)
+    , signature_()
+    , cache_()
+    , snapshot_()
+    , result_()
+    , problems_()
+#ifdef VISRULED_PROFILE
+    , elapsed_()
+#endif
+{
+    timer_.setSingleShot(true);
+    timer_.setInterval(500);
+    connect(&timer_, SIGNAL(timeout()), this, SLOT(start()));
+    connect(&watcher_, SIGNAL(finished()), this, SLOT(applyResult()));
+    invalidate();
+}
+
+PatternAnalyzer::~PatternAnalyzer()
+{
+    watcher_.waitForFinished();
+}
+
+void PatternAnalyzer::invalidate()
+{
+    if (running_) {
+        stale_ = true;
+    }
+    timer_.start();
+}
+
+void PatternAnalyzer::start()
+{
+    // a running check starts the next one when it's done
+    if (index_->root() == NULL || running_) {
+        return;
+    }
+
+    patternanalysis::Snapshot snapshot;
+    snapshot.index = index_->snapshot();
+    const QStringList& sdefs = fileConfig(index_->root()->filePath()).slSymbols();
+    foreach (const QString& sym, sdefs) {
+        snapshot.sdefs.insert(sym);
+    }
+
+    // the index changes whenever anything checked does, the cat-items replaced
+    // by an undo included
+    const QString signature = QString::number(snapshot.index.revision) + "\n" + sdefs.join(" ");
+    if (signature == signature_) {
+        updateProblems();
+        return;
+    }
+    signature_ = signature;
+    snapshot_ = snapshot.index;
+
+    running_ = true;
+    stale_ = false;
+#ifdef VISRULED_PROFILE
+    elapsed_.start();
+#endif
+    watcher_.setFuture(QtConcurrent::run(patternanalysis::compute, snapshot, cache_));
+}
+
+void PatternAnalyzer::applyResult()
+{
+    running_ = false;
+    if (stale_) {
+        // the nodes of this snapshot may be gone
+        signature_.clear();
+        start();
+        return;
+    }
+
+    result_ = watcher_.result();
+    cache_ = result_.cache;
+    result_.cache = patternanalysis::Cache();
+#ifdef VISRULED_PROFILE
+    qDebug() << "PatternAnalyzer:" << snapshot_.rules.size() << "rules checked in" << elapsed_.elapsed() << "ms";
+#endif
+    updateProblems();
+}
+
+void PatternAnalyzer::updateProblems()
+{
+    const QList<Node*>& rules = snapshot_.rules;
+    const QList<patterns::CatItem>& items = snapshot_.items;
+
+    problems_.clear();
+    foreach (const patternanalysis::ShadowedRule& sr, result_.rules) {
+        if (sr.rule >= rules.size() || sr.by >= rules.size()) {
+            continue;
+        }
+
+        Problem p;
+        p.node = rules[sr.rule];
+        const QString pattern = snapshot_.patterns.value(p.node).join(" ");
+        if (sr.by == -1) {
+            p.cause = NULL;
+            p.message = tr("Rule %1 (%2) is never applied, category %3 matches nothing")
+                    .arg(sr.rule+1).arg(pattern).arg(sr.category);
+        } else {
+            p.cause = rules[sr.by];
+            p.message = tr("Rule %1 (%2) is never applied, rule %3 (%4) matches everything it does")
+                    .arg(sr.rule+1).arg(pattern)
+                    .arg(sr.by+1).arg(snapshot_.patterns.value(p.cause).join(" "));
+        }
+        problems_.append(p);
+    }
+
+    foreach (const patternanalysis::DeadItem& di, result_.items) {
+        if (di.item >= items.size()) {
+            continue;
+        }
+
+        Problem p;
+        p.node = items[di.item].node;
+        p.cause = NULL;
+        p.message = tr("A cat-item of %1 never matches, the dictionary has no <%2>")
+                .arg(items[di.item].cat).arg(di.unknownTags.join(">, <"));
+        problems_.append(p);
+    }
+
+    emit finished();
+}
@@ -0,0 +1,145 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PATTERNANALYZER_H
+#define PATTERNANALYZER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QFutureWatcher>
+#ifdef VISRULED_PROFILE
+#include <QElapsedTimer>
+#endif
+#include "node.h"
+#include "patternindex.h"
+
+// Checks of PatternAnalyzer. Like scenelayout, it works on a plain copy, here
+// the one of the PatternIndex, so it can be run on a worker thread.
+namespace patternanalysis
+{
+    struct Snapshot
+    {
+        PatternIndex::Snapshot index;
+        // empty if there is no source language dictionary to check against
+        QSet<QString> sdefs;
+    };
+
+    // which categories cover which, kept between runs so that after an edit
+    // only the changed categories are compared again
+    struct Cache
+    {
+        QHash<QString, bool> covers;
+    };
+
+    struct ShadowedRule
+    {
+        // positions of the rules in the file
+        int rule;
+        // the earlier rule applied instead, -1 if the pattern can't match at all
+        int by;
+        // the category that can't match, if by is -1
+        QString category;
+    };
+
+    struct DeadItem
+    {
+        // index in the items of the snapshot
+        int item;
+        QStringList unknownTags;
+    };
+
+    struct Result
+    {
+        QVector<ShadowedRule> rules;
+        QVector<DeadItem> items;
+        Cache cache;
+    };
+
+    Result compute(const Snapshot& snapshot, const Cache& cache);
+}
+
+// Finds the rules transfer never applies because an earlier rule with an
+// equally long pattern matches everything they match, and the cat-items that
+// can't match any word because they use tags the source language dictionary
+// doesn't define.
+//
+// The rules shadowing a rule are found by walking the trie of the PatternIndex
+// along the categories covering those of the rule's pattern, so rules aren't
+// compared pairwise. The check runs on a worker thread a moment after the last
+// edit, and is skipped if the index hasn't changed.
+class PatternAnalyzer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Problem
+    {
+        // a rule or a cat-item
+        Node* node;
+        // the rule shadowing node, NULL if there is none
+        Node* cause;
+        QString message;
+    };
+
+    PatternAnalyzer(PatternIndex* index, QObject* parent = NULL);
+    ~PatternAnalyzer();
+
+    // the problems found by the last finished check
+    const QList<Problem>& problems() const { return problems_; }
+    bool isRunning() const { return running_ || timer_.isActive(); }
+
+public slots:
+    // the tree has changed, it's checked again after a short delay
+    void invalidate();
+
+signals:
+    void finished();
+
+private slots:
+    void start();
+    void applyResult();
+
+private:
+    void updateProblems();
+
+    PatternIndex* index_;
+    QTimer timer_;
+    QFutureWatcher<patternanalysis::Result> watcher_;
+    bool running_;
+    // an edit was made while the check was running, its result is outdated
+    bool stale_;
+    QString signature_;
+    patternanalysis::Cache cache_;
+
+    // the rules and cat-items the indices of result_ refer to
+    PatternIndex::Snapshot snapshot_;
+    patternanalysis::Result result_;
+    QList<Problem> problems_;
+#ifdef VISRULED_PROFILE
+    QElapsedTimer elapsed_;
+#endif
+};
+
+#endif // PATTERNANALYZER_H
@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "patterndialog.h"
+#include "ui_patterndialog.h"
+
+namespace
+{
+// n is only compared, it may have been deleted since the check
+bool contains(Node* root, Node* n)
+{
+    if (root == n) {
+        return true;
+    }
+
+    foreach (Node* ch, root->children()) {
+        if (contains(ch, n)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+}
+
+PatternDialog::PatternDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::PatternDialog),
+    file_(),
+    problems_()
+{
+    ui->setupUi(this);
+}
+
+PatternDialog::~PatternDialog()
+{
+    delete ui;
+}
+
+void PatternDialog::setFile(FileTab *ft)
+{
+    if (ft == file_) {
+        return;
+    }
+
+    if (file_ != NULL) {
+        disconnect(&file_->patternAnalyzer(), SIGNAL(finished()), this, SLOT(analyzerFinished()));
+    }
+
+    file_ = ft;
+    connect(&file_->patternAnalyzer(), SIGNAL(finished()), this, SLOT(analyzerFinished()));
+    analyzerFinished();
+}
+
+void PatternDialog::on_problemTable_cellDoubleClicked(int row, int column)
+{
+    if (file_ == NULL || row >= problems_.size()) {
+        return;
+    }
+
+    const PatternAnalyzer::Problem& p = problems_[row];
+    Node* n = column == 1 && p.cause != NULL ? p.cause : p.node;
+    if (contains(file_->rootNode(), n)) {
+        file_->showNode(n);
+    }
+}
+
+void PatternDialog::analyzerFinished()
+{
+    if (file_ == NULL) {
+        return;
+    }
+
+    const PatternAnalyzer& analyzer = file_->patternAnalyzer();
+    problems_ = analyzer.problems();
+
+    QTableWidget* table = ui->problemTable;
+    table->setRowCount(problems_.size());
+    for (int i = 0; i<problems_.size(); i++) {
+        const PatternAnalyzer::Problem& p = problems_[i];
+        table->setItem(i, 0, new QTableWidgetItem(p.message));
+        table->setItem(i, 1, new QTableWidgetItem(p.cause == NULL ? QString() : tr("Show")));
+    }
+
+    if (problems_.isEmpty()) {
+        ui->summary->setText(analyzer.isRunning() ? tr("Checking...") : tr("Every rule and cat-item can match."));
+    } else {
+        ui->summary->setText(tr("%n problem(s) found, double click one to show it.", "", problems_.size()));
+    }
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PATTERNDIALOG_H
+#define PATTERNDIALOG_H
+
+#include <QDialog>
+#include <QPointer>
+#include "filetab.h"
+
+namespace Ui {
+class PatternDialog;
+}
+
+// Lists the rules and cat-items PatternAnalyzer found to never match, updated
+// as the file is edited. Double clicking one shows it on the diagram.
+class PatternDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit PatternDialog(QWidget *parent = 0);
+    ~PatternDialog();
+
+    void setFile(FileTab* ft);
+
+public slots:
+    void on_problemTable_cellDoubleClicked(int row, int column);
+
+private slots:
+    void analyzerFinished();
+
+private:
+    Ui::PatternDialog *ui;
+    QPointer<FileTab> file_;
+    QList<PatternAnalyzer::Problem> problems_;
+};
+
+#endif // PATTERNDIALOG_H
@@ -0,0 +1,399 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "patternindex.h"
+
+#ifdef VISRULED_PROFILE
+#include <QElapsedTimer>
+#include <QDebug>
+#endif
+
+PatternIndex::PatternIndex(Node *root, QObject *parent)
+    : QObject(parent)
+    , root_(root)
+    , dirty_(true)
+    , revision_(0)
+    , states_(1)
+    , patterns_()
+    , positions_()
+    , rules_()
+    , longest_(0)
+    , items_()
+    , byFirstTag_()
+    , anyFirstTag_()
+    , catSignature_()
+{}
+
+void PatternIndex::setRoot(Node *root)
+{
+    root_ = root;
+    states_ = QVector<State>(1);
+    patterns_.clear();
+    positions_.clear();
+    rules_.clear();
+    longest_ = 0;
+    catSignature_.clear();
+    revision_++;
+    invalidate();
+}
+
+PatternIndex::Snapshot PatternIndex::snapshot()
+{
+    refresh();
+
+    Snapshot res;
+    res.revision = revision_;
+    res.items = items_;
+    res.states = states_;
+    res.rules = rules_;
+    res.positions = positions_;
+    res.patterns = patterns_;
+    return res;
+}
+
+Node* PatternIndex::match(const QString &input, int *length)
+{
+    refresh();
+
+    const QList<Word> ws = words(input, longest_);
+    Node* best = NULL;
+    int bestLength = 0;
+
+    // a word may be in several categories, so several paths are followed
+    QList<int> current;
+    current.append(0);
+    for (int k = 0; k<ws.size() && !current.isEmpty(); k++) {
+        const QSet<QString> cats = categoriesOf(ws[k], true);
+        QList<int> next;
+        foreach (int s, current) {
+            foreach (const QString& cat, cats) {
+                int n = states_[s].next.value(cat, -1);
+                if (n != -1) {
+                    next.append(n);
+                }
+            }
+        }
+
+        foreach (int s, next) {
+            foreach (Node* rule, states_[s].rules) {
+                if (bestLength < k+1 || positions_.value(rule) < positions_.value(best)) {
+                    best = rule;
+                    bestLength = k+1;
+                }
+            }
+        }
+        current = next;
+    }
+
+    if (length != NULL) {
+        *length = bestLength;
+    }
+    return best;
+}
+
+Node* PatternIndex::matchLinear(const QString &input, int *length)
+{
+    refresh();
+
+    const QList<Word> ws = words(input, longest_);
+    QList<QSet<QString> > cats;
+    foreach (const Word& w, ws) {
+        cats.append(categoriesOf(w, false));
+    }
+
+    Node* best = NULL;
+    int bestLength = 0;
+    foreach (Node* rule, rules_) {
+        const QStringList& pattern = patterns_[rule];
+        if (pattern.isEmpty() || pattern.size() <= bestLength || pattern.size() > cats.size()) {
+            continue;
+        }
+
+        bool matches = true;
+        for (int k = 0; k<pattern.size() && matches; k++) {
+            matches = cats[k].contains(pattern[k]);
+        }
+        if (matches) {
+            best = rule;
+            bestLength = pattern.size();
+        }
+    }
+
+    if (length != NULL) {
+        *length = bestLength;
+    }
+    return best;
+}
+
+void PatternIndex::refresh()
+{
+    if (!dirty_ || root_ == NULL) {
+        return;
+    }
+    dirty_ = false;
+
+    QList<Node*> defCats;
+    const QList<Node*> oldRules = rules_;
+    rules_.clear();
+    patterns::collect(root_, defCats, rules_);
+    refreshCategories(defCats);
+    if (rules_ != oldRules) {
+        revision_++;
+    }
+
+    positions_.clear();
+    for (int i = 0; i<rules_.size(); i++) {
+        Node* rule = rules_[i];
+        positions_[rule] = i;
+
+        const QStringList pattern = patterns::patternOf(rule);
+        QHash<Node*, QStringList>::ConstIterator old = patterns_.constFind(rule);
+        if (old != patterns_.constEnd()) {
+            if (old.value() == pattern) {
+                continue;
+            }
+            remove(rule, old.value());
+        }
+        insert(rule, pattern);
+    }
+
+    // rules removed from the tree
+    foreach (Node* rule, patterns_.keys()) {
+        if (!positions_.contains(rule)) {
+            remove(rule, patterns_.value(rule));
+            patterns_.remove(rule);
+        }
+    }
+}
+
+void PatternIndex::refreshCategories(const QList<Node *> &defCats)
+{
+    QList<patterns::CatItem> items;
+    QStringList signature;
+    foreach (Node* def, defCats) {
+        foreach (const patterns::CatItem& item, patterns::catItemsOf(def)) {
+            items.append(item);
+            // the node as well, a cat-item replaced by an undo is read again
+            signature.append(item.cat + "\t" + item.lemma + "\t" + item.tags.join(".")
+                             + "\t" + QString::number(quintptr(item.node), 16));
+        }
+    }
+
+    if (signature == catSignature_) {
+        return;
+    }
+
+    catSignature_ = signature;
+    items_ = items;
+    revision_++;
+    byFirstTag_.clear();
+    anyFirstTag_.clear();
+    for (int i = 0; i<items_.size(); i++) {
+        const QStringList& tags = items_[i].tags;
+        if (!tags.isEmpty() && tags.first() == "*") {
+            anyFirstTag_.append(i);
+        } else {
+            byFirstTag_[tags.value(0)].append(i);
+        }
+    }
+}
+
+void PatternIndex::insert(Node *rule, const QStringList &pattern)
+{
+    patterns_[rule] = pattern;
+    revision_++;
+    if (pattern.isEmpty()) {
+        return;
+    }
+
+    int s = 0;
+    foreach (const QString& cat, pattern) {
+        int n = states_[s].next.value(cat, -1);
+        if (n == -1) {
+            n = states_.size();
+            states_.append(State());
+            states_[s].next[cat] = n;
+        }
+        s = n;
+    }
+    states_[s].rules.append(rule);
+    longest_ = qMax(longest_, pattern.size());
+}
+
+void PatternIndex::remove(Node *rule, const QStringList &pattern)
+{
+    revision_++;
+    if (pattern.isEmpty()) {
+        return;
+    }
+
+    int s = 0;
+    foreach (const QString& cat, pattern) {
+        s = states_[s].next.value(cat, -1);
+        if (s == -1) {
+            return;
+        }
+    }
+    states_[s].rules.removeOne(rule);
+}
+
+QList<PatternIndex::Word> PatternIndex::words(const QString &input, int max) const
+{
+    QList<Word> res;
+    int i = 0;
+    while (res.size() < max) {
+        int start = input.indexOf('^', i);
+        if (start == -1) {
+            break;
+        }
+        int end = input.indexOf('$', start);
+        if (end == -1) {
+            break;
+        }
+
+        // the source side, e.g. cat<n><sg> of ^cat<n><sg>/gato<n><m><sg>$
+        QString lu = input.mid(start+1, end-start-1);
+        lu = lu.left(lu.indexOf('/'));
+
+        Word w;
+        int tag = lu.indexOf('<');
+        w.lemma = tag == -1 ? lu : lu.left(tag);
+        while (tag != -1) {
+            int close = lu.indexOf('>', tag);
+            if (close == -1) {
+                break;
+            }
+            w.tags.append(lu.mid(tag+1, close-tag-1));
+            tag = lu.indexOf('<', close);
+        }
+        res.append(w);
+        i = end+1;
+    }
+
+    return res;
+}
+
+QSet<QString> PatternIndex::categoriesOf(const Word &w, bool indexed) const
+{
+    QList<int> candidates;
+    if (indexed) {
+        candidates = byFirstTag_.value(w.tags.value(0)) + anyFirstTag_;
+    } else {
+        for (int i = 0; i<items_.size(); i++) {
+            candidates.append(i);
+        }
+    }
+
+    QSet<QString> res;
+    foreach (int i, candidates) {
+        const patterns::CatItem& item = items_[i];
+        if ((item.lemma.isEmpty() || item.lemma.compare(w.lemma, Qt::CaseInsensitive) == 0)
+                && patterns::matchTags(item.tags, w.tags)) {
+            res.insert(item.cat);
+        }
+    }
+
+    return res;
+}
+
+#ifdef VISRULED_PROFILE
+void PatternIndex::benchmark(int rules, int queries)
+{
+    const int catCount = 200;
+    qsrand(1);
+
+    // categories c<i> of words tagged <t<i>>, followed by anything
+    RootNode* root = new RootNode("transfer");
+    Node* cats = Node::create("section-def-cats");
+    root->addChild(cats);
+    for (int i = 0; i<catCount; i++) {
+        Node* def = Node::create("def-cat");
+        def->addProperty(new Property("def-cat/n", QString("c%1").arg(i)));
+        Node* item = Node::create("cat-item");
+        item->addChild(Node::create("__symbol_t" + QString::number(i)));
+        item->addChild(Node::create("__symbol_*"));
+        def->addChild(item);
+        cats->addChild(def);
+    }
+
+    Node* section = Node::create("section-rules");
+    root->addChild(section);
+    QList<QStringList> patterns;
+    for (int i = 0; i<rules; i++) {
+        Node* rule = Node::create("rule");
+        Node* pattern = Node::create("pattern");
+        rule->addChild(pattern);
+        QStringList p;
+        for (int k = 1 + qrand() % 4; k>0; k--) {
+            p.append(QString::number(qrand() % catCount));
+            Node* item = Node::create("pattern-item");
+            item->addProperty(new Property("pattern-item/n", "c" + p.last()));
+            pattern->addChild(item);
+        }
+        patterns.append(p);
+        section->addChild(rule);
+    }
+
+    // the words of a pattern, followed by a random one
+    QStringList inputs;
+    for (int i = 0; i<queries; i++) {
+        QString input;
+        foreach (const QString& cat, patterns[qrand() % patterns.size()]) {
+            input += "^w<t" + cat + "><sg>$ ";
+        }
+        inputs.append(input + QString("^w<t%1>$").arg(qrand() % catCount));
+    }
+
+    PatternIndex index(root);
+    QElapsedTimer timer;
+    timer.start();
+    index.refresh();
+    qDebug() << "PatternIndex::benchmark:" << rules << "rules indexed in" << timer.elapsed() << "ms";
+
+    QList<Node*> found;
+    timer.start();
+    foreach (const QString& input, inputs) {
+        found.append(index.match(input));
+    }
+    const qint64 indexed = timer.nsecsElapsed();
+
+    int differ = 0;
+    timer.start();
+    for (int i = 0; i<inputs.size(); i++) {
+        if (index.matchLinear(inputs[i]) != found[i]) {
+            differ++;
+        }
+    }
+    const qint64 linear = timer.nsecsElapsed();
+
+    qDebug() << "PatternIndex::benchmark:" << queries << "lookups," << indexed / 1000 / queries << "us with the index,"
+             << linear / 1000 / queries << "us with a linear scan," << differ << "different results";
+
+    // an edit only moves the changed rule
+    Property* n = section->children().first()->child("pattern")->children().first()->property("n");
+    n->setValue("c0");
+    index.invalidate();
+    timer.start();
+    index.refresh();
+    qDebug() << "PatternIndex::benchmark: index updated after an edit in" << timer.nsecsElapsed() / 1000 << "us";
+
+    delete root;
+}
+#endif
@@ -0,0 +1,134 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PATTERNINDEX_H
+#define PATTERNINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include "node.h"
+#include "patterns.h"
+
+// Finds the rule transfer would apply to some input without trying every
+// rule. The patterns of the rules, as sequences of category names, are kept in
+// a trie, and the cat-items are indexed by their first tag, so only a few of
+// them have to be checked for a word.
+//
+// The index follows the tree: after an edit only the rules whose pattern has
+// changed are moved in the trie, and the categories are indexed again only if
+// a def-cat has changed. States left empty by removed patterns are kept.
+class PatternIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct State
+    {
+        QHash<QString, int> next;
+        // the rules whose pattern ends here
+        QList<Node*> rules;
+    };
+
+    // A copy of the index, for PatternAnalyzer to walk on a worker thread. The
+    // containers are shared with the index until it changes; the nodes are only
+    // keys there and must not be dereferenced.
+    struct Snapshot
+    {
+        Snapshot() : revision(-1), items(), states(), rules(), positions(), patterns() {}
+
+        int revision;
+        QList<patterns::CatItem> items;
+        // state 0 is the root of the trie
+        QVector<State> states;
+        // in file order
+        QList<Node*> rules;
+        QHash<Node*, int> positions;
+        QHash<Node*, QStringList> patterns;
+    };
+
+    PatternIndex(Node* root = NULL, QObject* parent = NULL);
+
+    void setRoot(Node* root);
+    Node* root() const { return root_; }
+
+    // The rule applied to the start of input, given as lexical units of which
+    // only the source side is used, e.g. ^the<det><def><sp>$ ^cat<n><sg>$:
+    // the rule with the longest matching pattern, the first in the file among
+    // equally long ones. NULL if no rule matches, length is set to the number
+    // of words matched.
+    Node* match(const QString& input, int* length = NULL);
+    // the same, trying every rule and every cat-item in turn
+    Node* matchLinear(const QString& input, int* length = NULL);
+
+    // position of a rule in the file, starting from 0
+    int position(Node* rule) const { return positions_.value(rule, -1); }
+
+    // the index brought up to date with the tree
+    Snapshot snapshot();
+
+#ifdef VISRULED_PROFILE
+    // times both kinds of lookup on a generated file
+    static void benchmark(int rules, int queries);
+#endif
+
+public slots:
+    // the tree has changed, the index is updated before the next lookup
+    void invalidate() { dirty_ = true; }
+
+private:
+    struct Word
+    {
+        QString lemma;
+        QStringList tags;
+    };
+
+    void refresh();
+    void refreshCategories(const QList<Node*>& defCats);
+    void insert(Node* rule, const QStringList& pattern);
+    void remove(Node* rule, const QStringList& pattern);
+
+    QList<Word> words(const QString& input, int max) const;
+    QSet<QString> categoriesOf(const Word& w, bool indexed) const;
+
+    Node* root_;
+    bool dirty_;
+    // changed whenever the patterns, their order or the categories change
+    int revision_;
+
+    // state 0 is the root of the trie
+    QVector<State> states_;
+    QHash<Node*, QStringList> patterns_;
+    QHash<Node*, int> positions_;
+    QList<Node*> rules_;
+    int longest_;
+
+    QList<patterns::CatItem> items_;
+    QHash<QString, QList<int> > byFirstTag_;
+    // cat-items starting with a wildcard
+    QList<int> anyFirstTag_;
+    // the def-cats the items were read from, to notice when they change
+    QStringList catSignature_;
+};
+
+#endif // PATTERNINDEX_H
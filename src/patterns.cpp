@@ -0,0 +1,127 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "patterns.h"
+
+namespace
+{
+bool matchTags(const QStringList& pattern, int p, const QStringList& tags, int t)
+{
+    if (p == pattern.size()) {
+        return t == tags.size();
+    } else if (pattern[p] == "*") {
+        return matchTags(pattern, p+1, tags, t) || (t < tags.size() && matchTags(pattern, p, tags, t+1));
+    }
+
+    return t < tags.size() && pattern[p] == tags[t] && matchTags(pattern, p+1, tags, t+1);
+}
+
+bool coversTags(const QStringList& a, int p, const QStringList& b, int q)
+{
+    // a * of a covers any number of tags of b, including its wildcards, but a
+    // tag of a never covers a * of b
+    if (p == a.size()) {
+        return q == b.size();
+    } else if (a[p] == "*") {
+        return coversTags(a, p+1, b, q) || (q < b.size() && coversTags(a, p, b, q+1));
+    }
+
+    return q < b.size() && b[q] != "*" && a[p] == b[q] && coversTags(a, p+1, b, q+1);
+}
+}
+
+namespace patterns
+{
+
+void collect(Node *n, QList<Node *> &defCats, QList<Node *> &rules)
+{
+    if (n->name() == "def-cat") {
+        defCats.append(n);
+        return;
+    } else if (n->name() == "rule") {
+        rules.append(n);
+        return;
+    }
+
+    foreach (Node* ch, n->children()) {
+        collect(ch, defCats, rules);
+    }
+}
+
+QStringList patternOf(Node *rule)
+{
+    QStringList res;
+    Node* pattern = rule->child("pattern");
+    if (pattern == NULL) {
+        return res;
+    }
+
+    foreach (Node* item, pattern->children()) {
+        Property* n = item->property("n");
+        res.append(n == NULL ? QString() : n->value());
+    }
+
+    return res;
+}
+
+QStringList tagsOf(Node *catItem)
+{
+    QStringList res;
+    foreach (Node* sym, catItem->children()) {
+        if (sym->name().startsWith("__symbol_")) {
+            res.append(sym->name().mid(QString("__symbol_").size()));
+        }
+    }
+
+    return res;
+}
+
+QList<CatItem> catItemsOf(Node *defCat)
+{
+    QList<CatItem> res;
+    Property* n = defCat->property("n");
+    foreach (Node* ci, defCat->children()) {
+        if (ci->name() != "cat-item") {
+            continue;
+        }
+
+        CatItem item;
+        item.node = ci;
+        item.cat = n == NULL ? QString() : n->value();
+        Property* lemma = ci->property("lemma");
+        item.lemma = lemma == NULL ? QString() : lemma->value();
+        item.tags = tagsOf(ci);
+        res.append(item);
+    }
+
+    return res;
+}
+
+bool matchTags(const QStringList &pattern, const QStringList &tags)
+{
+    return ::matchTags(pattern, 0, tags, 0);
+}
+
+bool coversTags(const QStringList &a, const QStringList &b)
+{
+    return ::coversTags(a, 0, b, 0);
+}
+
+}
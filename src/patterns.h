@@ -0,0 +1,62 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include "node.h"
+
+// Reading rule patterns and categories from the node tree, and matching the
+// tags of cat-items, as done by PatternIndex, PatternAnalyzer, the built-in
+// transfer and the profiler.
+namespace patterns
+{
+    struct CatItem
+    {
+        CatItem() : node(NULL), cat(), lemma(), tags() {}
+
+        Node* node;
+        // the name of the def-cat
+        QString cat;
+        QString lemma;
+        QStringList tags;
+    };
+
+    // the def-cats and the rules under n, in file order
+    void collect(Node* n, QList<Node*>& defCats, QList<Node*>& rules);
+
+    // the category names of the pattern of a rule, empty for a pattern-item
+    // without one
+    QStringList patternOf(Node* rule);
+    // the tags of a cat-item, wildcards included
+    QStringList tagsOf(Node* catItem);
+    QList<CatItem> catItemsOf(Node* defCat);
+
+    // whether tags match the tags of a cat-item, where * stands for any
+    // number of tags
+    bool matchTags(const QStringList& pattern, const QStringList& tags);
+    // whether every tag sequence matched by b is matched by a as well
+    bool coversTags(const QStringList& a, const QStringList& b);
+}
+
+#endif // PATTERNS_H
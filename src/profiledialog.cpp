@@ -0,0 +1,202 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "profiledialog.h"
+#include "ui_profiledialog.h"
+#include "patterns.h"
+#include <QFileDialog>
+
+ProfileDialog::ProfileDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ProfileDialog),
+    file_(),
+    profiler_(NULL),
+    rules_(),
+    xml_(),
+    compileJob_(-1),
+    corpus_()
+{
+    ui->setupUi(this);
+}
+
+ProfileDialog::~ProfileDialog()
+{
+    delete ui;
+}
+
+void ProfileDialog::setFile(FileTab *ft)
+{
+    if (ft == file_) {
+        return;
+    }
+
+    // the profiler runs the tools of the old file
+    delete profiler_;
+    profiler_ = NULL;
+    if (file_ != NULL) {
+        disconnect(&file_->toolsManager(), SIGNAL(jobFinished(int,bool)), this, SLOT(compiled(int,bool)));
+    }
+    compileJob_ = -1;
+    file_ = ft;
+    connect(&file_->toolsManager(), SIGNAL(jobFinished(int,bool)), this, SLOT(compiled(int,bool)));
+    rules_.clear();
+    xml_.clear();
+    ui->hitTable->setRowCount(0);
+    ui->runButton->setEnabled(true);
+}
+
+void ProfileDialog::on_runButton_pressed()
+{
+    if (file_ == NULL) {
+        return;
+    }
+
+    // transfer runs the compiled file, the rules it reports have to be the
+    // ones in the editor
+    if (!file_->isSaved() || file_->filePath().isEmpty()) {
+        ui->summary->setText(tr("Save the file first, the corpus is run with the saved rules."));
+        return;
+    }
+
+    QString path = QFileDialog::getOpenFileName(this, tr("Run corpus"), QString(), tr("Corpus (*.txt *.tsv);;All files (*)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    // compiling skips the steps whose output is up to date
+    corpus_ = path;
+    ui->summary->setText(tr("Compiling..."));
+    ui->runButton->setEnabled(false);
+    compileJob_ = file_->toolsManager().compile();
+}
+
+void ProfileDialog::compiled(int job, bool successful)
+{
+    if (job != compileJob_) {
+        return;
+    }
+    compileJob_ = -1;
+
+    if (!successful) {
+        ui->summary->setText(tr("Compilation failed, the corpus wasn't run."));
+        ui->runButton->setEnabled(true);
+        return;
+    } else if (file_ == NULL || !file_->isSaved()) {
+        ui->summary->setText(tr("The file was changed while compiling, save it and run the corpus again."));
+        ui->runButton->setEnabled(true);
+        return;
+    }
+
+    if (profiler_ == NULL) {
+        profiler_ = new RuleProfiler(&file_->toolsManager(), this);
+        connect(profiler_, SIGNAL(finished(bool,QString)), this, SLOT(profileFinished(bool,QString)));
+    }
+
+    if (!profiler_->start(corpus_)) {
+        ui->summary->setText(tr("Can't read %1").arg(corpus_));
+        ui->runButton->setEnabled(true);
+        return;
+    }
+
+    // the rules are numbered as they are in the file being run
+    rules_ = RuleProfiler::rules(file_->rootNode());
+    xml_ = file_->rootNode()->toXml();
+    ui->summary->setText(tr("Running..."));
+}
+
+void ProfileDialog::on_clearButton_pressed()
+{
+    setHeat(QHash<Node*, qreal>());
+}
+
+void ProfileDialog::profileFinished(bool successful, const QString &error)
+{
+    ui->runButton->setEnabled(true);
+    if (!successful) {
+        ui->summary->setText(tr("Profiling failed: %1").arg(error));
+        return;
+    }
+
+    // the hits are counted for the rules as they were at the start; an edit
+    // may have renumbered them, or freed the nodes of rules_, which can be
+    // used only if they are all still in the tree
+    if (file_ == NULL || !file_->isSaved() || RuleProfiler::rules(file_->rootNode()) != rules_
+            || file_->rootNode()->toXml() != xml_) {
+        rules_.clear();
+        xml_.clear();
+        ui->summary->setText(tr("The file was changed while the corpus was run, run it again."));
+        return;
+    }
+
+    const QVector<int>& hits = profiler_->hits();
+    int dead = 0;
+
+    QTableWidget* table = ui->hitTable;
+    table->setSortingEnabled(false);
+    table->setRowCount(rules_.size());
+    for (int i = 0; i<rules_.size(); i++) {
+        Node* rule = rules_[i];
+        Property* comment = rule->property("comment");
+        const int h = hits.value(i);
+        if (h == 0) {
+            dead++;
+        }
+
+        // numbers are set as data, so that they are sorted as numbers
+        QTableWidgetItem* number = new QTableWidgetItem();
+        number->setData(Qt::DisplayRole, i+1);
+        QTableWidgetItem* count = new QTableWidgetItem();
+        count->setData(Qt::DisplayRole, h);
+
+        table->setItem(i, 0, number);
+        table->setItem(i, 1, new QTableWidgetItem(patternOf(rule)));
+        table->setItem(i, 2, new QTableWidgetItem(comment == NULL ? QString() : comment->value()));
+        table->setItem(i, 3, count);
+    }
+    table->setSortingEnabled(true);
+    table->sortByColumn(3, Qt::DescendingOrder);
+
+    ui->summary->setText(tr("%1 sentences, %2 of %3 rules never applied")
+                         .arg(profiler_->sentences()).arg(dead).arg(rules_.size()));
+    setHeat(RuleProfiler::heat(rules_, hits));
+}
+
+void ProfileDialog::setHeat(const QHash<Node *, qreal> &heat)
+{
+    if (file_ == NULL) {
+        return;
+    }
+
+    for (int i = 0; i<file_->sectionCount(); i++) {
+        file_->sectionTab(i)->setHeat(heat);
+    }
+}
+
+QString ProfileDialog::patternOf(Node *rule)
+{
+    QStringList cats = patterns::patternOf(rule);
+    for (int i = 0; i<cats.size(); i++) {
+        if (cats[i].isEmpty()) {
+            cats[i] = "?";
+        }
+    }
+
+    return cats.join(" ");
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PROFILEDIALOG_H
+#define PROFILEDIALOG_H
+
+#include <QDialog>
+#include <QPointer>
+#include "filetab.h"
+#include "profiler.h"
+
+namespace Ui {
+class ProfileDialog;
+}
+
+// Shows how often the rules of a file fire on a corpus, as a sortable table
+// and as a heatmap on the diagram.
+class ProfileDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ProfileDialog(QWidget *parent = 0);
+    ~ProfileDialog();
+
+    void setFile(FileTab* ft);
+
+public slots:
+    void on_runButton_pressed();
+    void on_clearButton_pressed();
+
+private slots:
+    void compiled(int job, bool successful);
+    void profileFinished(bool successful, const QString& error);
+
+private:
+    void setHeat(const QHash<Node*, qreal>& heat);
+    static QString patternOf(Node* rule);
+
+    Ui::ProfileDialog *ui;
+    QPointer<FileTab> file_;
+    RuleProfiler* profiler_;
+    // the rules and the file the corpus is run with; the result is dropped if
+    // they have changed by the time it's done
+    QList<Node*> rules_;
+    QString xml_;
+    // the compilation run before profiling, -1 if there is none
+    int compileJob_;
+    QString corpus_;
+};
+
+#endif // PROFILEDIALOG_H
@@ -0,0 +1,209 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "profiler.h"
+#include "patterns.h"
+#include <QFile>
+#include <QTextStream>
+#include <QRegExp>
+#include <qmath.h>
+
+RuleProfiler::RuleProfiler(const ToolsManager *tools, QObject *parent)
+    : QObject(parent)
+    , tools_(tools)
+    , analyser_(NULL)
+    , transfer_(NULL)
+    , trace_()
+    , hits_()
+    , sentences_(0)
+{}
+
+RuleProfiler::~RuleProfiler()
+{
+    stop();
+}
+
+bool RuleProfiler::start(const QString &corpus)
+{
+    QFile f(corpus);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    stop();
+    hits_.clear();
+    trace_.clear();
+    sentences_ = 0;
+
+    QString text;
+    QTextStream in(&f);
+    in.setCodec("UTF-8");
+    while (!in.atEnd()) {
+        QString l = in.readLine();
+        if (l.trimmed().isEmpty() || l.startsWith('#')) {
+            continue;
+        }
+        text += l.left(l.indexOf('\t')) + "\n";
+        sentences_++;
+    }
+
+    // the tools run once over the whole text, not in null flush mode
+    ToolWorker::Command morph = tools_->stageCommand(ToolsManager::MORPH);
+    morph.args.removeAll("-z");
+    analyser_ = startTool(morph, SLOT(analysed(int)));
+    analyser_->write(text.toUtf8());
+    analyser_->closeWriteChannel();
+
+    return true;
+}
+
+QProcess* RuleProfiler::startTool(const ToolWorker::Command &command, const char *finished)
+{
+    QProcess* proc = new QProcess(this);
+    connect(proc, SIGNAL(finished(int)), this, finished);
+    connect(proc, SIGNAL(error(QProcess::ProcessError)), this, SLOT(processError()));
+    proc->start(command.program, command.args);
+
+    return proc;
+}
+
+void RuleProfiler::analysed(int retval)
+{
+    if (retval != 0) {
+        fail(QString::fromLocal8Bit(analyser_->readAllStandardError()));
+        return;
+    }
+
+    const QString analyses = ToolsManager::stripSurfaceForms(QString::fromUtf8(analyser_->readAllStandardOutput()));
+    analyser_->deleteLater();
+    analyser_ = NULL;
+
+    ToolWorker::Command transfer = tools_->stageCommand(ToolsManager::TRANSFER);
+    transfer.args.replaceInStrings(QRegExp("^-z$"), "-t");
+    transfer_ = startTool(transfer, SLOT(transferred(int)));
+    // only the trace is needed, and it can be long, so it is counted as it
+    // comes
+    transfer_->setStandardOutputFile(QProcess::nullDevice());
+    connect(transfer_, SIGNAL(readyReadStandardError()), this, SLOT(readTrace()));
+    transfer_->write(analyses.toUtf8());
+    transfer_->closeWriteChannel();
+}
+
+void RuleProfiler::readTrace()
+{
+    trace_ += transfer_->readAllStandardError();
+
+    int end = trace_.lastIndexOf('\n');
+    if (end == -1) {
+        return;
+    }
+
+    const QString lines = QString::fromUtf8(trace_.constData(), end);
+    trace_.remove(0, end + 1);
+
+    QRegExp rx("Rule (\\d+)");
+    int pos = 0;
+    while ((pos = rx.indexIn(lines, pos)) != -1) {
+        const int n = rx.cap(1).toInt();
+        if (n > 0) {
+            if (hits_.size() < n) {
+                hits_.resize(n);
+            }
+            hits_[n-1]++;
+        }
+        pos += rx.matchedLength();
+    }
+}
+
+void RuleProfiler::transferred(int retval)
+{
+    trace_ += "\n";
+    readTrace();
+
+    if (retval != 0) {
+        fail(tr("apertium-transfer exited with %1").arg(retval));
+        return;
+    }
+
+    transfer_->deleteLater();
+    transfer_ = NULL;
+    emit finished(true, QString());
+}
+
+void RuleProfiler::processError()
+{
+    // the other errors are followed by finished()
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    if (proc != NULL && proc->error() == QProcess::FailedToStart) {
+        fail(proc->program() + ": " + proc->errorString());
+    }
+}
+
+void RuleProfiler::cancel()
+{
+    if (isRunning()) {
+        stop();
+        emit finished(false, tr("Canceled"));
+    }
+}
+
+void RuleProfiler::fail(const QString &error)
+{
+    stop();
+    emit finished(false, error.trimmed());
+}
+
+void RuleProfiler::stop()
+{
+    foreach (QProcess* proc, QList<QProcess*>() << analyser_ << transfer_) {
+        if (proc != NULL) {
+            proc->disconnect(this);
+            proc->kill();
+            proc->waitForFinished(500);
+            proc->deleteLater();
+        }
+    }
+    analyser_ = NULL;
+    transfer_ = NULL;
+}
+
+QList<Node*> RuleProfiler::rules(Node *root)
+{
+    QList<Node*> defCats;
+    QList<Node*> res;
+    patterns::collect(root, defCats, res);
+    return res;
+}
+
+QHash<Node*, qreal> RuleProfiler::heat(const QList<Node *> &rules, const QVector<int> &hits)
+{
+    int max = 0;
+    foreach (int h, hits) {
+        max = qMax(max, h);
+    }
+
+    QHash<Node*, qreal> res;
+    for (int i = 0; i<rules.size(); i++) {
+        const int h = hits.value(i);
+        res[rules[i]] = max == 0 ? 0 : qLn(1 + h) / qLn(1 + max);
+    }
+
+    return res;
+}
@@ -0,0 +1,80 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QVector>
+#include <QHash>
+#include "node.h"
+#include "tools.h"
+
+// Counts how often each rule fires on a corpus. The text is analysed with
+// lt-proc and run through apertium-transfer -t, which reports every rule it
+// applies as "Rule <n>" on the standard error, numbering the rules from 1 in
+// the order of the file. The corpus may be plain text or a regression corpus
+// (see CorpusRunner), in which case only the sentences are used.
+class RuleProfiler : public QObject
+{
+    Q_OBJECT
+public:
+    RuleProfiler(const ToolsManager* tools, QObject* parent = NULL);
+    ~RuleProfiler();
+
+    // returns false if the corpus can't be read
+    bool start(const QString& corpus);
+    void cancel();
+    bool isRunning() const { return analyser_ != NULL || transfer_ != NULL; }
+
+    // hits by rule number, starting from 0
+    const QVector<int>& hits() const { return hits_; }
+    int sentences() const { return sentences_; }
+
+    // the rule nodes under root, in file order
+    static QList<Node*> rules(Node* root);
+    // heat of the rules for a heatmap, on a logarithmic scale relative to the
+    // most used rule
+    static QHash<Node*, qreal> heat(const QList<Node*>& rules, const QVector<int>& hits);
+
+signals:
+    void finished(bool successful, const QString& error);
+
+private slots:
+    void analysed(int retval);
+    void readTrace();
+    void transferred(int retval);
+    void processError();
+
+private:
+    QProcess* startTool(const ToolWorker::Command& command, const char* finished);
+    void stop();
+    void fail(const QString& error);
+
+    const ToolsManager* tools_;
+    QProcess* analyser_;
+    QProcess* transfer_;
+    QByteArray trace_;
+    QVector<int> hits_;
+    int sentences_;
+};
+
+#endif // PROFILER_H
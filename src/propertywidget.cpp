@@ -114,6 +114,7 @@ PropertyWidget::PropertyWidget(Property *prop, Box *parent)
     , value_(NULL)
     , setValueFunc_(NULL)
     , getValueFunc_(NULL)
+    , updating_(false)
 {
     VisualSchema::Property pdef = appConfig().property(prop->fullName());
     switch (pdef.type) {
@@ -168,17 +169,35 @@ PropertyWidget::PropertyWidget(Property *prop, Box *parent)
 void PropertyWidget::updateWidgets()
 {
     label_->setText(appearance::formatTextNormal(appConfig().property(prop_->fullName()).label));
-    setValueFunc_(prop_->value(), value_, prop_);
+    setValue(prop_->value());
     label_->show();
     value_->show();
 }
 
+void PropertyWidget::setValue(const QString &str)
+{
+    // don't touch an editor which already shows the value: it would reset the
+    // cursor while typing
+    if (getValueFunc_(value_, prop_) == str) {
+        return;
+    }
+
+    updating_ = true;
+    setValueFunc_(str, value_, prop_);
+    updating_ = false;
+}
+
 void PropertyWidget::updateValue()
 {
-    //actions::ChangeProperty *cp = new actions::ChangeProperty(this, getValueFunc_(value_, prop_));
-    //resources::actionStack.push(cp);
+    // changes made by setValue come from the model, not from the user
+    if (updating_) {
+        return;
+    }
 
-    prop_->setValue(getValueFunc_(value_, prop_));
+    QString value = getValueFunc_(value_, prop_);
+    if (value != prop_->value()) {
+        parent_->actionStack().push(new actions::ChangeProperty(this, value));
+    }
 }
 
 void PropertyWidget::showContextMenu(const QPoint& where)
@@ -47,7 +47,7 @@ public:
 public slots:
     void updateValue();
     void updateWidgets();
-    void setValue(const QString& str) { setValueFunc_(str, value_, prop_); }
+    void setValue(const QString& str);
 
     void showContextMenu(const QPoint &where);
 private:
@@ -57,6 +57,7 @@ private:
     QWidget* value_;
     void (*setValueFunc_)(const QString&, QWidget*, Property*);
     QString (*getValueFunc_)(QWidget*, Property*);
+    bool updating_;
 };
 
 #endif // PROPERTYWIDGET_H
@@ -0,0 +1,1123 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scenediagram.h"
+#include "config.h"
+#include "resources.h"
+#include <cmath>
+#include <algorithm>
+#include <QtCore/qmath.h>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QMimeData>
+#include <QMenu>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QtConcurrentRun>
+#include <QDebug>
+
+namespace
+{
+const int spacing = 6;
+
+// below this zoom level rules are drawn as glyphs and can't be edited
+const qreal detailZoom = 0.6;
+const qreal minZoom = 0.05;
+const qreal maxZoom = 2.0;
+const qreal zoomStep = 1.25;
+
+QString plainText(const QString& str)
+{
+    QString res = str;
+    res.replace("&lt;", "<");
+    res.replace("&gt;", ">");
+    res.replace("&amp;", "&");
+    return res;
+}
+
+QString displayValue(const Property* p)
+{
+    VisualSchema::Property pdef = appConfig().property(p->fullName());
+    if (pdef.type == proptype::SELECTION) {
+        return appConfig().valueMap().list(pdef.valueListId).value(p->value());
+    }
+
+    return p->value();
+}
+
+QString mimeName(const QMimeData* mime, const QString& format)
+{
+    QString name;
+    QByteArray mdata = mime->data(format);
+    QDataStream stream(&mdata, QIODevice::ReadOnly);
+    stream >> name;
+    return name;
+}
+
+bool isAttached(Node* n, Node* root)
+{
+    while (n != root) {
+        Node* p = n->parentNode();
+        if (p == NULL || !p->children().contains(n)) {
+            return false;
+        }
+        n = p;
+    }
+
+    return true;
+}
+}
+
+SceneDiagram::SceneDiagram(Node *data, QWidget *parent)
+    : QWidget(parent)
+    , data_(data)
+    , stack_()
+    , roots_()
+    , rows_()
+    , pendingRoots_()
+    , pendingItems_()
+    , layoutWatcher_()
+    , layoutPending_(false)
+    , dirty_()
+    , allDirty_(false)
+    , sceneSize_()
+    , zoom_(1.0)
+    , selectedNode_(NULL)
+    , editor_()
+    , editedProp_(NULL)
+    , editedNode_(NULL)
+    , boldFont_(font())
+    , heat_()
+    , queuedInput_()
+{
+    boldFont_.setBold(true);
+    setAcceptDrops(true);
+    setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(this, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(showContextMenu(QPoint)));
+    connect(&stack_, SIGNAL(nodeChanged(Node*)), this, SLOT(nodeChanged(Node*)));
+    connect(&layoutWatcher_, SIGNAL(finished()), this, SLOT(applyLayout()));
+
+    rebuild();
+}
+
+SceneDiagram::~SceneDiagram()
+{
+    layoutWatcher_.waitForFinished();
+    // the two lists share the items of unchanged nodes
+    qDeleteAll((roots_.toSet() + pendingRoots_.toSet()).toList());
+}
+
+void SceneDiagram::rebuild()
+{
+    allDirty_ = true;
+    relayout();
+}
+
+void SceneDiagram::nodeChanged(Node *n)
+{
+    // only the top level node containing the change is built again, unless
+    // the change is unknown; a change of data_ itself is a top level node
+    // added, removed or moved, the items of the others are kept
+    if (n == NULL) {
+        rebuild();
+        return;
+    }
+
+    while (n != data_ && n->parentNode() != data_) {
+        n = n->parentNode();
+        if (n == NULL) {
+            rebuild();
+            return;
+        }
+    }
+
+    if (n != data_) {
+        dirty_.insert(n);
+    }
+    relayout();
+}
+
+void SceneDiagram::relayout()
+{
+    closeEditor();
+
+    // the newest items are the pending ones, a layout still running for them
+    // is superseded
+    const QList<SceneItem*> current = layoutPending_ ? pendingRoots_ : roots_;
+    const QSet<SceneItem*> displayed = roots_.toSet();
+    pendingItems_.clear();
+
+    if (data_ == NULL) {
+        qDeleteAll((displayed + pendingRoots_.toSet()).toList());
+        roots_.clear();
+        pendingRoots_.clear();
+        rows_.clear();
+        dirty_.clear();
+        allDirty_ = false;
+        layoutPending_ = false;
+        queuedInput_.clear();
+        return;
+    }
+
+    if (selectedNode_ != NULL && !isAttached(selectedNode_, data_)) {
+        selectedNode_ = NULL;
+    }
+
+    QHash<Node*, SceneItem*> reusable;
+    if (!allDirty_) {
+        foreach (SceneItem* item, current) {
+            if (!dirty_.contains(item->node)) {
+                reusable[item->node] = item;
+            }
+        }
+    }
+
+    // the changed items are built and their text measured here, the geometry
+    // is computed on a worker thread; until it is done, the previous scene
+    // stays on screen
+    const FileConfiguration& conf = fileConfig(data_->filePath());
+    QList<SceneItem*> next;
+    foreach (Node* n, data_->children()) {
+        SceneItem* item = reusable.take(n);
+        next.append(item == NULL ? build(n, NULL, NULL, conf) : item);
+    }
+
+    // pending items which are neither shown nor kept
+    const QSet<SceneItem*> kept = next.toSet();
+    foreach (SceneItem* item, pendingRoots_) {
+        if (!kept.contains(item) && !displayed.contains(item)) {
+            delete item;
+        }
+    }
+    pendingRoots_ = next;
+    dirty_.clear();
+    allDirty_ = false;
+
+    scenelayout::Snapshot snapshot;
+    foreach (SceneItem* item, pendingRoots_) {
+        snapshot.roots.append(addToSnapshot(item, snapshot));
+    }
+
+    layoutPending_ = true;
+    layoutWatcher_.setFuture(QtConcurrent::run(scenelayout::compute, snapshot));
+}
+
+int SceneDiagram::addToSnapshot(SceneItem *item, scenelayout::Snapshot &snapshot)
+{
+    int index = snapshot.boxes.size();
+    pendingItems_.append(item);
+
+    scenelayout::Box box;
+    box.labelSize = item->labelRect.size();
+    box.propsSize = item->propsSize;
+    box.horizontal = item->horizontal;
+    snapshot.boxes.append(box);
+
+    foreach (SceneItem* ch, item->children) {
+        int c = addToSnapshot(ch, snapshot);
+        snapshot.boxes[index].children.append(c);
+    }
+
+    foreach (SceneItem* at, item->arrowTargets) {
+        int c = addToSnapshot(at, snapshot);
+        snapshot.boxes[index].arrowTargets.append(c);
+    }
+
+    return index;
+}
+
+void SceneDiagram::applyLayout()
+{
+    scenelayout::Result res = layoutWatcher_.result();
+    if (res.boxes.size() != pendingItems_.size()) {
+        return;
+    }
+
+    for (int i = 0; i<pendingItems_.size(); i++) {
+        SceneItem* item = pendingItems_[i];
+        const scenelayout::Geometry& geom = res.boxes[i];
+        item->rect = geom.rect;
+        item->labelRect = geom.labelRect;
+
+        // kept items were laid out before
+        const QPoint delta = geom.propsOrigin - item->propsOrigin;
+        for (int j = 0; j<item->props.size(); j++) {
+            item->props[j].labelRect.translate(delta);
+            item->props[j].valueRect.translate(delta);
+        }
+        item->propsOrigin = geom.propsOrigin;
+    }
+
+    const QSet<SceneItem*> kept = pendingRoots_.toSet();
+    foreach (SceneItem* item, roots_) {
+        if (!kept.contains(item)) {
+            delete item;
+        }
+    }
+    roots_ = pendingRoots_;
+    rows_.clear();
+    foreach (const scenelayout::Row& r, res.rows) {
+        Row row;
+        row.bounds = r.bounds;
+        foreach (int i, r.items) {
+            row.items.append(pendingItems_[i]);
+        }
+        rows_.append(row);
+    }
+
+    pendingRoots_.clear();
+    pendingItems_.clear();
+    layoutPending_ = false;
+
+    sceneSize_ = res.size;
+    updateSize();
+    emit sceneChanged();
+    replayInput();
+}
+
+void SceneDiagram::updateSize()
+{
+    setMinimumSize(QSize(qCeil(sceneSize_.width() * zoom_), qCeil(sceneSize_.height() * zoom_)));
+    updateGeometry();
+    update();
+}
+
+void SceneDiagram::setZoom(qreal zoom)
+{
+    zoom = qBound(minZoom, zoom, maxZoom);
+    if (qFuzzyCompare(zoom, zoom_)) {
+        return;
+    }
+
+    commitEditor();
+    closeEditor();
+    zoom_ = zoom;
+    updateSize();
+    emit zoomChanged(zoom_);
+}
+
+void SceneDiagram::zoomIn()
+{
+    setZoom(zoom_ * zoomStep);
+}
+
+void SceneDiagram::zoomOut()
+{
+    setZoom(zoom_ / zoomStep);
+}
+
+void SceneDiagram::resetZoom()
+{
+    setZoom(1.0);
+}
+
+bool SceneDiagram::detailed() const
+{
+    return zoom_ >= detailZoom;
+}
+
+QPoint SceneDiagram::toScene(const QPoint &p) const
+{
+    return QPoint(qFloor(p.x() / zoom_), qFloor(p.y() / zoom_));
+}
+
+void SceneDiagram::setHeat(const QHash<Node *, qreal> &heat)
+{
+    heat_ = heat;
+    if (data_ == NULL) {
+        return;
+    }
+
+    const FileConfiguration& conf = fileConfig(data_->filePath());
+    foreach (SceneItem* item, roots_ + pendingRoots_) {
+        updateColors(item, conf);
+    }
+
+    update();
+    emit sceneChanged();
+}
+
+QColor SceneDiagram::colorOf(Node *n, const FileConfiguration &conf) const
+{
+    const qreal heat = heat_.value(n, -1);
+    const QColor base = conf.tag(n->name()).boxColor;
+
+    return heat < 0 ? base : appearance::heatColor(base, heat);
+}
+
+void SceneDiagram::updateColors(SceneItem *item, const FileConfiguration &conf)
+{
+    item->color = colorOf(item->node, conf);
+    foreach (SceneItem* child, item->children + item->arrowTargets) {
+        updateColors(child, conf);
+    }
+}
+
+SceneItem* SceneDiagram::build(Node *n, SceneItem *parent, SceneItem *anchor, const FileConfiguration &conf)
+{
+    SceneItem* item = new SceneItem(n, parent);
+    VisualSchema::Tag tdef = conf.tag(n->name());
+    item->label = plainText(tdef.label);
+    item->color = colorOf(n, conf);
+    item->horizontal = tdef.nesting == "horizontal";
+
+    if (anchor == NULL) {
+        anchor = item;
+    }
+
+    foreach (Property* p, n->properties()) {
+        SceneItem::Prop prop;
+        prop.data = p;
+        prop.label = plainText(appConfig().property(p->fullName()).label);
+        prop.value = displayValue(p);
+        item->props.append(prop);
+    }
+
+    // arrow targets are laid out in the column after the one their anchor
+    // (the nearest ancestor reached without crossing an arrow) is in
+    foreach (Node* ch, n->children()) {
+        if (conf.connection(n->name(), ch->name()).type == contype::ARROW) {
+            anchor->arrowTargets.append(build(ch, item, NULL, conf));
+        } else {
+            item->children.append(build(ch, item, anchor, conf));
+        }
+    }
+
+    measure(item);
+
+    if (parent == NULL) {
+        summarize(item);
+    }
+
+    return item;
+}
+
+void SceneDiagram::summarize(SceneItem *item)
+{
+    // the glyph of a rule lists the categories of its pattern, other top
+    // level nodes are identified by their property values
+    QStringList parts;
+    Node* pattern = item->node->child("pattern");
+    if (pattern != NULL) {
+        foreach (Node* pi, pattern->children()) {
+            Property* p = pi->property("n");
+            if (p != NULL) {
+                parts.append(p->value());
+            }
+        }
+    } else {
+        foreach (const SceneItem::Prop& p, item->props) {
+            if (!p.value.isEmpty()) {
+                parts.append(p.value);
+            }
+        }
+    }
+
+    item->summary = parts.isEmpty() ? item->label : parts.join(" ");
+
+    item->actionCount = 0;
+    foreach (const SceneItem* at, item->arrowTargets) {
+        item->actionCount += at->node->children().size();
+    }
+
+    if (!item->arrowTargets.isEmpty()) {
+        item->summary += QString("  (%1)").arg(item->actionCount);
+    }
+}
+
+void SceneDiagram::measure(SceneItem *item)
+{
+    QFontMetrics bold(boldFont_);
+    QFontMetrics normal(font());
+
+    if (!item->props.isEmpty()) {
+        const int h = normal.height() + 8;
+        int w = 0;
+        for (int i = 0; i<item->props.size(); i++) {
+            SceneItem::Prop& p = item->props[i];
+            int lw = normal.width(p.label);
+            int vw = std::max(80, normal.width(p.value) + 12);
+            p.labelRect = QRect(w, 0, lw, h);
+            p.valueRect = QRect(w + lw + spacing, 0, vw, h);
+            w += lw + vw + 2*spacing;
+        }
+        item->propsSize = QSize(w - spacing, h);
+    }
+
+    item->labelRect = QRect(QPoint(0, 0), bold.size(Qt::TextSingleLine, item->label));
+}
+
+int SceneDiagram::rowAt(int y) const
+{
+    int lo = 0;
+    int hi = rows_.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (rows_[mid].bounds.bottom() < y) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+void SceneDiagram::paintEvent(QPaintEvent *ev)
+{
+    QPainter painter(this);
+    painter.fillRect(ev->rect(), Qt::white);
+
+    const QTransform toDevice = QTransform::fromScale(zoom_, zoom_);
+    const QRect clip = toDevice.inverted().mapRect(ev->rect()).adjusted(-1, -1, 1, 1);
+
+    if (!detailed()) {
+        paintGlyphs(painter, clip, toDevice, true);
+        return;
+    }
+
+    painter.setTransform(toDevice);
+
+    for (int i = rowAt(clip.top()); i < rows_.size() && rows_[i].bounds.top() <= clip.bottom(); i++) {
+        const Row& row = rows_[i];
+        foreach (const SceneItem* item, row.items) {
+            paintItem(painter, item, clip);
+        }
+
+        painter.setPen(QPen(Qt::black, 1));
+        painter.setBrush(Qt::black);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        foreach (const SceneItem* item, row.items) {
+            if (item->parent != NULL) {
+                paintArrow(painter, item->parent, item);
+            }
+        }
+        painter.setRenderHint(QPainter::Antialiasing, false);
+    }
+}
+
+void SceneDiagram::paintGlyphs(QPainter &qp, const QRect &clip, const QTransform &toDevice, bool text) const
+{
+    // glyphs are painted in device coordinates, so that the text stays
+    // readable and outlines stay one pixel wide at any zoom level
+    QFontMetrics fm(font());
+    qp.setFont(font());
+
+    for (int i = rowAt(clip.top()); i < rows_.size() && rows_[i].bounds.top() <= clip.bottom(); i++) {
+        foreach (const SceneItem* item, rows_[i].items) {
+            if (!item->rect.intersects(clip)) {
+                continue;
+            }
+
+            QRect r = toDevice.mapRect(item->rect);
+            if (r.height() < 3) {
+                qp.fillRect(r, item->color);
+                continue;
+            }
+
+            qp.setPen(QPen(Qt::black, item->node == selectedNode_ ? 3 : 1));
+            qp.setBrush(item->color);
+            qp.drawRect(r);
+
+            if (text && item->parent == NULL && r.height() >= fm.height()) {
+                qp.setPen(appearance::fontColor());
+                qp.drawText(r.adjusted(3, 0, -3, 0), Qt::AlignLeft | Qt::AlignVCenter | Qt::TextSingleLine,
+                            fm.elidedText(item->summary, Qt::ElideRight, r.width() - 6));
+            }
+        }
+    }
+}
+
+void SceneDiagram::paintItem(QPainter &qp, const SceneItem *item, const QRect &clip) const
+{
+    if (!item->rect.intersects(clip)) {
+        return;
+    }
+
+    qp.setPen(QPen(Qt::black, item->node == selectedNode_ ? 4 : 1));
+    qp.setBrush(item->color);
+    qp.drawRect(item->rect);
+
+    qp.setPen(appearance::fontColor());
+    qp.setFont(boldFont_);
+    qp.drawText(item->labelRect, Qt::AlignLeft | Qt::AlignVCenter, item->label);
+
+    qp.setFont(font());
+    foreach (const SceneItem::Prop& p, item->props) {
+        qp.setPen(appearance::fontColor());
+        qp.drawText(p.labelRect, Qt::AlignLeft | Qt::AlignVCenter, p.label);
+        qp.setPen(QPen(Qt::black, 1));
+        qp.setBrush(Qt::white);
+        qp.drawRect(p.valueRect);
+        qp.setPen(appearance::fontColor());
+        qp.drawText(p.valueRect.adjusted(4, 0, -4, 0), Qt::AlignLeft | Qt::AlignVCenter, p.value);
+    }
+
+    foreach (const SceneItem* ch, item->children) {
+        paintItem(qp, ch, clip);
+    }
+}
+
+void SceneDiagram::paintArrow(QPainter &qp, const SceneItem *from, const SceneItem *to) const
+{
+    QPointF a(from->rect.right(), from->rect.center().y());
+    QPointF b(to->rect.left(), to->rect.center().y());
+
+    double d = sqrt(pow(a.x() - b.x(), 2) + pow(a.y() - b.y(), 2));
+    if (d < 1) {
+        return;
+    }
+
+    double bx = b.x() * (d - 5)/d + a.x() * 5/d;
+    double by = b.y() * (d - 5)/d + a.y() * 5/d;
+    double angle = asin((b.x() - a.x()) / d);
+
+    if ((b.y() - a.y()) > 0) {
+        angle *= -1;
+    }
+
+    QPointF arrowHead[3] = {
+        b,
+        QPointF(bx + 3*cos(angle), by + 3*sin(angle)),
+        QPointF(bx - 3*cos(angle), by - 3*sin(angle))
+    };
+
+    qp.drawConvexPolygon(arrowHead, 3);
+    qp.drawLine(a, b);
+}
+
+SceneItem* SceneDiagram::itemAt(const QPoint &p) const
+{
+    int r = rowAt(p.y());
+    if (r >= rows_.size() || !rows_[r].bounds.contains(p)) {
+        return NULL;
+    }
+
+    foreach (SceneItem* item, rows_[r].items) {
+        SceneItem* res = itemAt(item, p);
+        if (res != NULL) {
+            return res;
+        }
+    }
+
+    return NULL;
+}
+
+SceneItem* SceneDiagram::itemAt(SceneItem *item, const QPoint &p) const
+{
+    if (!item->rect.contains(p)) {
+        return NULL;
+    }
+
+    foreach (SceneItem* ch, item->children) {
+        SceneItem* res = itemAt(ch, p);
+        if (res != NULL) {
+            return res;
+        }
+    }
+
+    return item;
+}
+
+int SceneDiagram::propertyAt(const SceneItem *item, const QPoint &p) const
+{
+    for (int i = 0; i<item->props.size(); i++) {
+        if (item->props[i].valueRect.contains(p) || item->props[i].labelRect.contains(p)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void SceneDiagram::select(Node *n)
+{
+    selectedNode_ = n;
+    update();
+    resources::mainWindow->updateSidebar();
+}
+
+QRect SceneDiagram::rectOf(Node *n) const
+{
+    foreach (SceneItem* root, roots_) {
+        SceneItem* item = itemFor(root, n);
+        if (item != NULL) {
+            return QRect(item->rect.topLeft() * zoom_, item->rect.size() * zoom_);
+        }
+    }
+
+    return QRect();
+}
+
+SceneItem* SceneDiagram::itemFor(SceneItem *item, Node *n) const
+{
+    if (item->node == n) {
+        return item;
+    }
+
+    foreach (SceneItem* child, item->children + item->arrowTargets) {
+        SceneItem* res = itemFor(child, n);
+        if (res != NULL) {
+            return res;
+        }
+    }
+
+    return NULL;
+}
+
+void SceneDiagram::mousePressEvent(QMouseEvent *ev)
+{
+    // finish a pending edit first: it may rebuild the scene
+    commitEditor();
+
+    // the scene on screen may refer to nodes which are gone already, so the
+    // click is handled once the new one is laid out
+    if (layoutPending_) {
+        QueuedInput in;
+        in.kind = QueuedInput::PRESS;
+        in.pos = ev->pos();
+        in.button = ev->button();
+        queuedInput_.append(in);
+        return;
+    }
+
+    press(ev->pos(), ev->button());
+}
+
+void SceneDiagram::press(const QPoint &where, Qt::MouseButton button)
+{
+    const QPoint pos = toScene(where);
+    SceneItem* item = itemAt(pos);
+    if (item == NULL) {
+        select(NULL);
+        return;
+    }
+
+    // glyphs stand for the whole rule
+    if (!detailed()) {
+        while (item->parent != NULL) {
+            item = item->parent;
+        }
+        select(item->node);
+        return;
+    }
+
+    select(item->node);
+
+    int prop = propertyAt(item, pos);
+    if (prop != -1 && button == Qt::LeftButton && item->props[prop].valueRect.contains(pos)) {
+        editProperty(item, prop);
+    }
+}
+
+void SceneDiagram::wheelEvent(QWheelEvent *ev)
+{
+    if (!(ev->modifiers() & Qt::ControlModifier)) {
+        ev->ignore();
+        return;
+    }
+
+    if (ev->angleDelta().y() > 0) {
+        zoomIn();
+    } else if (ev->angleDelta().y() < 0) {
+        zoomOut();
+    }
+    ev->accept();
+}
+
+void SceneDiagram::editProperty(SceneItem *item, int index)
+{
+    const SceneItem::Prop& p = item->props[index];
+    VisualSchema::Property pdef = appConfig().property(p.data->fullName());
+
+    QWidget* editor = NULL;
+    switch (pdef.type) {
+    case proptype::SELECTION:
+    {
+        QComboBox* cb = new QComboBox(this);
+        QMap<QString, QString> vals = appConfig().valueMap().list(pdef.valueListId);
+        for (QMap<QString, QString>::ConstIterator i = vals.constBegin(); i != vals.constEnd(); i++) {
+            cb->addItem(i.value(), i.key());
+        }
+        cb->setCurrentIndex(cb->findData(p.data->value()));
+        connect(cb, SIGNAL(activated(int)), this, SLOT(commitEditor()));
+        editor = cb;
+        break;
+    }
+    case proptype::INTEGER:
+    {
+        QSpinBox* sb = new QSpinBox(this);
+        sb->setMinimum(1);
+        sb->setMaximum(99);
+        sb->setValue(p.data->valueToInt(1));
+        connect(sb, SIGNAL(editingFinished()), this, SLOT(commitEditor()));
+        editor = sb;
+        break;
+    }
+    case proptype::STRING:
+    case proptype::UNKNOWN:
+    default:
+    {
+        QLineEdit* qle = new QLineEdit(p.data->value(), this);
+        connect(qle, SIGNAL(editingFinished()), this, SLOT(commitEditor()));
+        editor = qle;
+        break;
+    }
+    }
+
+    editedProp_ = p.data;
+    editedNode_ = item->node;
+    editor_ = editor;
+
+    QRect geom = QTransform::fromScale(zoom_, zoom_).mapRect(p.valueRect);
+    geom.setHeight(std::max(geom.height(), editor->sizeHint().height()));
+    editor->setGeometry(geom);
+    editor->show();
+    editor->setFocus();
+}
+
+void SceneDiagram::commitEditor()
+{
+    QWidget* editor = editor_;
+    if (editor == NULL || (sender() != NULL && sender() != editor)) {
+        return;
+    }
+
+    QString value;
+    if (QComboBox* cb = qobject_cast<QComboBox*>(editor)) {
+        value = cb->itemData(cb->currentIndex()).toString();
+    } else if (QSpinBox* sb = qobject_cast<QSpinBox*>(editor)) {
+        value = QString::number(sb->value());
+    } else if (QLineEdit* qle = qobject_cast<QLineEdit*>(editor)) {
+        value = qle->text();
+    }
+
+    Property* prop = editedProp_;
+    Node* node = editedNode_;
+    closeEditor();
+
+    if (value != prop->value()) {
+        stack_.push(new actions::SetPropertyValue(prop, node, value));
+    }
+}
+
+void SceneDiagram::closeEditor()
+{
+    // clear the members before hiding, since losing focus makes the editor
+    // emit editingFinished again
+    QWidget* editor = editor_;
+    editor_ = NULL;
+    editedProp_ = NULL;
+    editedNode_ = NULL;
+
+    if (editor != NULL) {
+        editor->hide();
+        editor->deleteLater();
+    }
+}
+
+void SceneDiagram::showContextMenu(const QPoint &where)
+{
+    commitEditor();
+
+    if (layoutPending_) {
+        QueuedInput in;
+        in.kind = QueuedInput::CONTEXT_MENU;
+        in.pos = where;
+        queuedInput_.append(in);
+        return;
+    }
+
+    contextMenu(where);
+}
+
+void SceneDiagram::contextMenu(const QPoint &where)
+{
+    const QPoint pos = toScene(where);
+    SceneItem* item = detailed() ? itemAt(pos) : NULL;
+    Node* target = item == NULL ? data_ : item->node;
+    int propIndex = item == NULL ? -1 : propertyAt(item, pos);
+    Property* prop = propIndex == -1 ? NULL : item->props[propIndex].data;
+
+    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(target->name());
+    QMenu menu(this);
+
+    QAction* delProp = NULL;
+    if (prop != NULL) {
+        delProp = menu.addAction("Delete property");
+    }
+
+    QAction* del = NULL;
+    if (item != NULL) {
+        del = menu.addAction("Delete");
+    }
+
+    QMap<QAction*, QString> centries;
+    if (!tdef.children.isEmpty()) {
+        QMenu* cmenu = menu.addMenu("Add child");
+        foreach(QString str, tdef.children) {
+            QAction* a = cmenu->addAction(str);
+            centries[a] = str;
+        }
+    }
+
+    QMap<QAction*, QString> pentries;
+    if (item != NULL && !tdef.properties.isEmpty()) {
+        QMenu* pmenu = menu.addMenu("Add property");
+        foreach(QString str, tdef.properties) {
+            QAction* a = pmenu->addAction(str);
+            pentries[a] = str;
+        }
+    }
+
+    QAction* res = menu.exec(mapToGlobal(where));
+
+    if (res == NULL) {
+        return;
+    } else if (res == delProp) {
+        stack_.push(new actions::RemoveNodeProperty(prop, target));
+    } else if (res == del) {
+        stack_.beginTransaction();
+        stack_.push(new actions::RemoveNode(target));
+        stack_.commitTransaction();
+    } else if (centries.contains(res)) {
+        insertChild(centries[res], target);
+    } else if (pentries.contains(res)) {
+        Property* pr = new Property(pentries[res], "");
+        stack_.push(new actions::AddNodeProperty(pr, target));
+    }
+}
+
+bool SceneDiagram::acceptsDrop(const QMimeData *mime, const QPoint &p) const
+{
+    QString format;
+    QString name;
+    if (!dropData(mime, format, name)) {
+        return false;
+    }
+
+    // checked again when the drop is replayed on the new scene
+    if (layoutPending_) {
+        return true;
+    }
+
+    return acceptsDrop(format, name, p);
+}
+
+bool SceneDiagram::acceptsDrop(const QString &format, const QString &name, const QPoint &p) const
+{
+    if (!detailed()) {
+        return false;
+    }
+
+    SceneItem* item = itemAt(toScene(p));
+    Node* target = item == NULL ? data_ : item->node;
+    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(target->name());
+
+    if (format == "application/x-dnd-visruledbox") {
+        return tdef.children.contains(name);
+    }
+
+    return item != NULL && tdef.properties.contains(name);
+}
+
+bool SceneDiagram::dropData(const QMimeData *mime, QString &format, QString &name)
+{
+    if (mime->hasFormat("application/x-dnd-visruledbox")) {
+        format = "application/x-dnd-visruledbox";
+    } else if (mime->hasFormat("application/x-dnd-visruledprop")) {
+        format = "application/x-dnd-visruledprop";
+    } else {
+        return false;
+    }
+
+    name = mimeName(mime, format);
+    return true;
+}
+
+void SceneDiagram::dragEnterEvent(QDragEnterEvent *ev)
+{
+    if (acceptsDrop(ev->mimeData(), ev->pos())) {
+        ev->acceptProposedAction();
+    } else {
+        ev->ignore();
+    }
+}
+
+void SceneDiagram::dragMoveEvent(QDragMoveEvent *ev)
+{
+    if (acceptsDrop(ev->mimeData(), ev->pos())) {
+        ev->acceptProposedAction();
+    } else {
+        ev->ignore();
+    }
+}
+
+void SceneDiagram::dropEvent(QDropEvent *ev)
+{
+    if (!acceptsDrop(ev->mimeData(), ev->pos())) {
+        return;
+    }
+    ev->accept();
+
+    QueuedInput in;
+    in.kind = QueuedInput::DROP;
+    in.pos = ev->pos();
+    dropData(ev->mimeData(), in.format, in.name);
+    if (layoutPending_) {
+        queuedInput_.append(in);
+        return;
+    }
+
+    drop(in.pos, in.format, in.name);
+}
+
+void SceneDiagram::drop(const QPoint &where, const QString &format, const QString &name)
+{
+    if (!acceptsDrop(format, name, where)) {
+        return;
+    }
+
+    SceneItem* item = itemAt(toScene(where));
+    Node* target = item == NULL ? data_ : item->node;
+
+    if (format == "application/x-dnd-visruledbox") {
+        insertChild(name, target);
+    } else {
+        stack_.push(new actions::AddNodeProperty(new Property(name, ""), target));
+    }
+}
+
+void SceneDiagram::insertChild(const QString &name, Node *to)
+{
+    // the node and its mandatory properties are one step
+    stack_.beginTransaction();
+    Node* n = Node::create(name, false, to);
+    stack_.push(new actions::InsertNode(n, to, to->children().size()));
+    foreach (const QString& prop, appConfig().tag(name).properties) {
+        if (appConfig().property(prop).isMandatory) {
+            stack_.push(new actions::AddNodeProperty(new Property(prop, ""), n));
+        }
+    }
+    stack_.commitTransaction();
+}
+
+void SceneDiagram::replayInput()
+{
+    // an input may start another layout, the rest waits for that one
+    while (!layoutPending_ && !queuedInput_.isEmpty()) {
+        QueuedInput in = queuedInput_.takeFirst();
+        switch (in.kind) {
+        case QueuedInput::PRESS:
+            press(in.pos, in.button);
+            break;
+        case QueuedInput::CONTEXT_MENU:
+            contextMenu(in.pos);
+            break;
+        case QueuedInput::DROP:
+            drop(in.pos, in.format, in.name);
+            break;
+        }
+    }
+}
+
+SceneOverview::SceneOverview(SceneDiagram *scene, QScrollArea *view, QWidget *parent)
+    : QWidget(parent)
+    , scene_(scene)
+    , view_(view)
+    , cache_()
+{
+    setFixedWidth(120);
+    setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding);
+
+    connect(scene_, SIGNAL(sceneChanged()), this, SLOT(invalidate()));
+    connect(scene_, SIGNAL(zoomChanged(qreal)), this, SLOT(update()));
+    connect(view_->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(update()));
+    connect(view_->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(update()));
+}
+
+void SceneOverview::invalidate()
+{
+    cache_ = QPixmap();
+    update();
+}
+
+qreal SceneOverview::scale() const
+{
+    QSize s = scene_->sceneSize();
+    if (s.isEmpty()) {
+        return 1.0;
+    }
+
+    return std::min(qreal(width()) / s.width(), qreal(height()) / s.height());
+}
+
+void SceneOverview::paintEvent(QPaintEvent *)
+{
+    // the scene only changes on relayout, scrolling just moves the frame
+    if (cache_.size() != size()) {
+        cache_ = QPixmap(size());
+        cache_.fill(Qt::white);
+        QPainter cp(&cache_);
+        const QSize s = scene_->sceneSize();
+        scene_->paintGlyphs(cp, QRect(QPoint(0, 0), s), QTransform::fromScale(scale(), scale()), false);
+    }
+
+    QPainter painter(this);
+    painter.drawPixmap(0, 0, cache_);
+
+    // the visible part of the scene
+    const qreal f = scale() / scene_->zoom();
+    QRect visible(view_->horizontalScrollBar()->value(), view_->verticalScrollBar()->value(),
+                  view_->viewport()->width(), view_->viewport()->height());
+    painter.setPen(QPen(Qt::red, 1));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(QTransform::fromScale(f, f).mapRect(visible));
+}
+
+void SceneOverview::mousePressEvent(QMouseEvent *ev)
+{
+    centerOn(ev->pos());
+}
+
+void SceneOverview::mouseMoveEvent(QMouseEvent *ev)
+{
+    if (ev->buttons() & Qt::LeftButton) {
+        centerOn(ev->pos());
+    }
+}
+
+void SceneOverview::resizeEvent(QResizeEvent *)
+{
+    invalidate();
+}
+
+void SceneOverview::centerOn(const QPoint &p)
+{
+    const qreal f = scene_->zoom() / scale();
+    view_->horizontalScrollBar()->setValue(qRound(p.x() * f) - view_->viewport()->width() / 2);
+    view_->verticalScrollBar()->setValue(qRound(p.y() * f) - view_->viewport()->height() / 2);
+}
@@ -0,0 +1,257 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCENEDIAGRAM_H
+#define SCENEDIAGRAM_H
+
+#include <QWidget>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPointer>
+#include <QColor>
+#include <QFont>
+#include <QFutureWatcher>
+#include <QPixmap>
+#include <QTransform>
+#include "node.h"
+#include "action.h"
+#include "scenelayout.h"
+
+class FileConfiguration;
+class QScrollArea;
+
+struct SceneItem
+{
+    struct Prop
+    {
+        Property* data;
+        QString label;
+        QString value;
+        QRect labelRect;
+        QRect valueRect;
+    };
+
+    SceneItem(Node* n, SceneItem* p)
+        : node(n)
+        , parent(p)
+        , label()
+        , color()
+        , horizontal(false)
+        , rect()
+        , labelRect()
+        , propsSize()
+        , props()
+        , children()
+        , arrowTargets()
+        , summary()
+        , actionCount(0)
+        , propsOrigin()
+    {}
+
+    ~SceneItem()
+    {
+        qDeleteAll(children);
+        qDeleteAll(arrowTargets);
+    }
+
+    Node* node;
+    SceneItem* parent;
+    QString label;
+    QColor color;
+    bool horizontal;
+    QRect rect;
+    QRect labelRect;
+    QSize propsSize;
+    QList<Prop> props;
+    QList<SceneItem*> children;
+    QList<SceneItem*> arrowTargets;
+
+    // glyph text of top level items, used at low zoom
+    QString summary;
+    int actionCount;
+
+    // where the props were moved by the last layout
+    QPoint propsOrigin;
+
+private:
+    SceneItem(const SceneItem&);
+};
+
+// A lightweight alternative to Diagram for big sections: the whole section is
+// kept as a plain scene model and painted directly, so no widgets are created
+// for boxes and properties. Editors are only created for the property being
+// edited. Layout is computed off the GUI thread, see scenelayout.h.
+class SceneDiagram : public QWidget
+{
+    Q_OBJECT
+public:
+    SceneDiagram(Node* data, QWidget* parent = NULL);
+    ~SceneDiagram();
+
+    Node* data() const { return data_; }
+    ActionStack& actionStack() { return stack_; }
+    Node* selectedNode() const { return selectedNode_ == NULL ? data_ : selectedNode_; }
+
+    qreal zoom() const { return zoom_; }
+    void setZoom(qreal zoom);
+    bool detailed() const;
+
+    // size of the scene at zoom level 1
+    QSize sceneSize() const { return sceneSize_; }
+
+    // paints the simplified representation of the scene (a box per rule in its
+    // colour, with its pattern categories and number of actions if text is set)
+    void paintGlyphs(QPainter& qp, const QRect& clip, const QTransform& toDevice, bool text) const;
+
+    // see Diagram::setHeat
+    void setHeat(const QHash<Node*, qreal>& heat);
+
+    void select(Node* n);
+    // where n is drawn at the current zoom, empty if it isn't
+    QRect rectOf(Node* n) const;
+
+public slots:
+    void rebuild();
+    void showContextMenu(const QPoint& where);
+    void zoomIn();
+    void zoomOut();
+    void resetZoom();
+
+signals:
+    void sceneChanged();
+    void zoomChanged(qreal zoom);
+
+protected:
+    void paintEvent(QPaintEvent* ev);
+    void mousePressEvent(QMouseEvent* ev);
+    void wheelEvent(QWheelEvent* ev);
+    void dragEnterEvent(QDragEnterEvent* ev);
+    void dragMoveEvent(QDragMoveEvent* ev);
+    void dropEvent(QDropEvent* ev);
+
+private slots:
+    void commitEditor();
+    void applyLayout();
+    // rebuilds the items of the top level node containing n
+    void nodeChanged(Node* n);
+
+private:
+    struct Row
+    {
+        QRect bounds;
+        QList<SceneItem*> items;
+    };
+
+    // input received while a layout is pending, in widget coordinates
+    struct QueuedInput
+    {
+        enum Kind { PRESS, CONTEXT_MENU, DROP };
+
+        QueuedInput() : kind(PRESS), pos(), button(Qt::NoButton), format(), name() {}
+
+        Kind kind;
+        QPoint pos;
+        Qt::MouseButton button;
+        // mime format and name of a drop
+        QString format;
+        QString name;
+    };
+
+    void relayout();
+    SceneItem* build(Node* n, SceneItem* parent, SceneItem* anchor, const FileConfiguration& conf);
+    void measure(SceneItem* item);
+    void summarize(SceneItem* item);
+    void updateSize();
+    QPoint toScene(const QPoint& p) const;
+    int addToSnapshot(SceneItem* item, scenelayout::Snapshot& snapshot);
+    QColor colorOf(Node* n, const FileConfiguration& conf) const;
+    void updateColors(SceneItem* item, const FileConfiguration& conf);
+
+    void paintItem(QPainter& qp, const SceneItem* item, const QRect& clip) const;
+    void paintArrow(QPainter& qp, const SceneItem* from, const SceneItem* to) const;
+
+    int rowAt(int y) const;
+    SceneItem* itemAt(const QPoint& p) const;
+    SceneItem* itemAt(SceneItem* item, const QPoint& p) const;
+    int propertyAt(const SceneItem* item, const QPoint& p) const;
+    bool acceptsDrop(const QMimeData* mime, const QPoint& p) const;
+    bool acceptsDrop(const QString& format, const QString& name, const QPoint& p) const;
+    static bool dropData(const QMimeData* mime, QString& format, QString& name);
+
+    void press(const QPoint& where, Qt::MouseButton button);
+    void contextMenu(const QPoint& where);
+    void drop(const QPoint& where, const QString& format, const QString& name);
+    void insertChild(const QString& name, Node* to);
+    void replayInput();
+
+    void editProperty(SceneItem* item, int index);
+    void closeEditor();
+    SceneItem* itemFor(SceneItem* item, Node* n) const;
+
+    Node* data_;
+    ActionStack stack_;
+    QList<SceneItem*> roots_;
+    QVector<Row> rows_;
+    QList<SceneItem*> pendingRoots_;
+    QVector<SceneItem*> pendingItems_;
+    QFutureWatcher<scenelayout::Result> layoutWatcher_;
+    bool layoutPending_;
+    // top level nodes whose items have to be built again
+    QSet<Node*> dirty_;
+    bool allDirty_;
+    QSize sceneSize_;
+    qreal zoom_;
+    Node* selectedNode_;
+    QPointer<QWidget> editor_;
+    Property* editedProp_;
+    Node* editedNode_;
+    QFont boldFont_;
+    QHash<Node*, qreal> heat_;
+    QList<QueuedInput> queuedInput_;
+};
+
+// Minimap of a SceneDiagram, painted from the same glyphs as the zoomed out
+// scene. Clicking or dragging on it scrolls the view.
+class SceneOverview : public QWidget
+{
+    Q_OBJECT
+public:
+    SceneOverview(SceneDiagram* scene, QScrollArea* view, QWidget* parent = NULL);
+
+public slots:
+    void invalidate();
+
+protected:
+    void paintEvent(QPaintEvent* ev);
+    void mousePressEvent(QMouseEvent* ev);
+    void mouseMoveEvent(QMouseEvent* ev);
+    void resizeEvent(QResizeEvent* ev);
+
+private:
+    qreal scale() const;
+    void centerOn(const QPoint& p);
+
+    SceneDiagram* scene_;
+    QScrollArea* view_;
+    QPixmap cache_;
+};
+
+#endif // SCENEDIAGRAM_H
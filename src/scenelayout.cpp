@@ -0,0 +1,144 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scenelayout.h"
+#include <algorithm>
+
+namespace scenelayout
+{
+namespace
+{
+const int margin = 9;
+const int spacing = 6;
+const int rowGap = 10;
+const int columnGap = 50;
+
+void measure(const Snapshot& s, int index, QVector<Geometry>& g)
+{
+    const Box& box = s.boxes[index];
+
+    QVector<QSize> parts;
+    parts.append(box.labelSize);
+
+    if (!box.propsSize.isEmpty()) {
+        parts.append(box.propsSize);
+    }
+
+    foreach (int ch, box.children) {
+        measure(s, ch, g);
+        parts.append(g[ch].rect.size());
+    }
+
+    int along = spacing * (parts.size() - 1);
+    int across = 0;
+    foreach (const QSize& size, parts) {
+        along += box.horizontal ? size.width() : size.height();
+        across = std::max(across, box.horizontal ? size.height() : size.width());
+    }
+
+    if (box.horizontal) {
+        g[index].rect = QRect(0, 0, along + 2*margin, across + 2*margin);
+    } else {
+        g[index].rect = QRect(0, 0, across + 2*margin, along + 2*margin);
+    }
+}
+
+void place(const Snapshot& s, int index, int x, int y, QVector<Geometry>& g)
+{
+    const Box& box = s.boxes[index];
+    Geometry& geom = g[index];
+    geom.rect.moveTo(x, y);
+
+    int cx = x + margin;
+    int cy = y + margin;
+    geom.labelRect = QRect(QPoint(cx, cy), box.labelSize);
+    if (box.horizontal) {
+        cx += box.labelSize.width() + spacing;
+    } else {
+        cy += box.labelSize.height() + spacing;
+    }
+
+    geom.propsOrigin = QPoint(cx, cy);
+    if (!box.propsSize.isEmpty()) {
+        if (box.horizontal) {
+            cx += box.propsSize.width() + spacing;
+        } else {
+            cy += box.propsSize.height() + spacing;
+        }
+    }
+
+    foreach (int ch, box.children) {
+        place(s, ch, cx, cy, g);
+        if (box.horizontal) {
+            cx += g[ch].rect.width() + spacing;
+        } else {
+            cy += g[ch].rect.height() + spacing;
+        }
+    }
+}
+
+QPoint layoutColumn(const Snapshot& s, const QVector<int>& col, QPoint start, QVector<Geometry>& g, Row& row)
+{
+    QVector<int> nextColumn;
+
+    start.setX(start.x() + 20);
+
+    int curY = start.y() + 20;
+    int maxWidth = 0;
+
+    foreach (int index, col) {
+        measure(s, index, g);
+        place(s, index, start.x(), curY, g);
+        row.items.append(index);
+        maxWidth = std::max(maxWidth, g[index].rect.width());
+        curY += g[index].rect.height() + rowGap;
+        nextColumn += s.boxes[index].arrowTargets;
+    }
+
+    QPoint next(start.x() + maxWidth + columnGap, -1);
+
+    if (!nextColumn.isEmpty()) {
+        next = layoutColumn(s, nextColumn, QPoint(start.x() + maxWidth + columnGap, start.y()), g, row);
+    }
+
+    return QPoint(next.x(), std::max(curY, next.y()));
+}
+}
+
+Result compute(const Snapshot &snapshot)
+{
+    Result res;
+    res.boxes.resize(snapshot.boxes.size());
+
+    QPoint p(0, 0);
+    int maxX = 50;
+    foreach (int root, snapshot.roots) {
+        Row row;
+        int top = p.y();
+        p.setX(0);
+        p = layoutColumn(snapshot, QVector<int>() << root, p, res.boxes, row);
+        maxX = std::max(maxX, p.x());
+        row.bounds = QRect(0, top, p.x(), p.y() - top);
+        res.rows.append(row);
+    }
+
+    res.size = QSize(maxX, p.y() + 50);
+    return res;
+}
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCENELAYOUT_H
+#define SCENELAYOUT_H
+
+#include <QVector>
+#include <QRect>
+#include <QSize>
+#include <QPoint>
+
+// Geometry engine of SceneDiagram. Everything that needs the node tree or font
+// metrics is collected into a Snapshot on the GUI thread; compute() only works
+// on that copy, so it can be run on a worker thread.
+namespace scenelayout
+{
+    struct Box
+    {
+        Box() : labelSize(), propsSize(), horizontal(false), children(), arrowTargets() {}
+
+        QSize labelSize;
+        QSize propsSize;   // empty if the box has no properties
+        bool horizontal;
+        QVector<int> children;
+        QVector<int> arrowTargets;
+    };
+
+    struct Snapshot
+    {
+        QVector<Box> boxes;
+        QVector<int> roots;
+    };
+
+    struct Geometry
+    {
+        QRect rect;
+        QRect labelRect;
+        QPoint propsOrigin;
+    };
+
+    struct Row
+    {
+        QRect bounds;
+        QVector<int> items;
+    };
+
+    struct Result
+    {
+        QVector<Geometry> boxes;
+        QVector<Row> rows;
+        QSize size;
+    };
+
+    Result compute(const Snapshot& snapshot);
+}
+
+#endif // SCENELAYOUT_H
@@ -20,18 +20,42 @@
 #include "sectiontab.h"
 #include "ui_sectiontab.h"
 #include "diagram.h"
+#include "config.h"
 #include <QDebug>
 #include <QScrollArea>
+#include <QShortcut>
 
 SectionTab::SectionTab(QWidget *parent, Node *root) :
     QWidget(parent),
     ui(new Ui::SectionTab),
-    sectionRoot_(root)
+    sectionRoot_(root),
+    diagram_(NULL),
+    scene_(NULL)
 {
     ui->setupUi(this);
 
-    Diagram* d = findChild<Diagram*>("diagram");
-    d->setData(root);
+    diagram_ = findChild<Diagram*>("diagram");
+
+    // big sections would need tens of thousands of widgets, draw them instead
+    if (root->children().size() >= appConfig().sceneThreshold()) {
+        QScrollArea* sa = findChild<QScrollArea*>("scrollArea");
+        scene_ = new SceneDiagram(root);
+        sa->setWidget(scene_);
+        ui->horizontalLayout->addWidget(new SceneOverview(scene_, sa, this));
+        diagram_ = NULL;
+
+        QShortcut* zin = new QShortcut(QKeySequence::ZoomIn, this);
+        QShortcut* zout = new QShortcut(QKeySequence::ZoomOut, this);
+        QShortcut* zreset = new QShortcut(QKeySequence("Ctrl+0"), this);
+        zin->setContext(Qt::WidgetWithChildrenShortcut);
+        zout->setContext(Qt::WidgetWithChildrenShortcut);
+        zreset->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(zin, SIGNAL(activated()), scene_, SLOT(zoomIn()));
+        connect(zout, SIGNAL(activated()), scene_, SLOT(zoomOut()));
+        connect(zreset, SIGNAL(activated()), scene_, SLOT(resetZoom()));
+    } else {
+        diagram_->setData(root);
+    }
 }
 
 SectionTab::~SectionTab()
@@ -41,12 +65,47 @@ SectionTab::~SectionTab()
 
 ActionStack& SectionTab::actionStack()
 {
-    Diagram* d = findChild<Diagram*>("diagram");
-    return d->actionStack();
+    if (scene_ != NULL) {
+        return scene_->actionStack();
+    }
+
+    return diagram_->actionStack();
+}
+
+void SectionTab::setHeat(const QHash<Node *, qreal> &heat)
+{
+    if (scene_ != NULL) {
+        scene_->setHeat(heat);
+    } else {
+        diagram_->setHeat(heat);
+    }
 }
 
-DiagramElement* SectionTab::selectedBox() const
+void SectionTab::showNode(Node *n)
 {
-    Diagram* d = findChild<Diagram*>("diagram");
-    return d->selectedBox();
+    QScrollArea* sa = findChild<QScrollArea*>("scrollArea");
+    if (scene_ != NULL) {
+        scene_->select(n);
+        QRect r = scene_->rectOf(n);
+        if (!r.isEmpty()) {
+            sa->ensureVisible(r.center().x(), r.center().y(), r.width()/2, r.height()/2);
+        }
+        return;
+    }
+
+    DiagramElement* de = diagram_->elementFor(n);
+    if (de != NULL) {
+        diagram_->registerSelection(de);
+        sa->ensureWidgetVisible(de);
+    }
+}
+
+Node* SectionTab::selectedNode() const
+{
+    if (scene_ != NULL) {
+        return scene_->selectedNode();
+    }
+
+    DiagramElement* de = diagram_->selectedBox();
+    return de == NULL ? NULL : de->data();
 }
@@ -25,6 +25,7 @@
 #include "node.h"
 #include "action.h"
 #include "diagram.h"
+#include "scenediagram.h"
 
 namespace Ui {
 class SectionTab;
@@ -40,12 +41,21 @@ public:
 
     ActionStack& actionStack();
 
-    DiagramElement* selectedBox() const;
+    Node* selectedNode() const;
+
+    // see Diagram::setHeat
+    void setHeat(const QHash<Node*, qreal>& heat);
+
+    Node* sectionRoot() const { return sectionRoot_; }
+    // selects n and scrolls to it
+    void showNode(Node* n);
     
 private:
     Ui::SectionTab *ui;
 
     Node* sectionRoot_;
+    Diagram* diagram_;
+    SceneDiagram* scene_;
 };
 
 #endif // SECTIONTAB_H
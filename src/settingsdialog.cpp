@@ -21,6 +21,7 @@
 #include "ui_settingsdialog.h"
 #include "config.h"
 #include <QFileDialog>
+#include <QSpinBox>
 
 SettingsDialog::SettingsDialog(QWidget *parent) :
     QDialog(parent),
@@ -53,6 +54,31 @@ QString SettingsDialog::apertiumPreprocTrans() const
     return qle->text();
 }
 
+int SettingsDialog::toolJobs() const
+{
+    QSpinBox* qsb = findChild<QSpinBox*>("toolJobs");
+    return qsb->value();
+}
+
+int SettingsDialog::undoLimit() const
+{
+    QSpinBox* qsb = findChild<QSpinBox*>("undoLimit");
+    return qsb->value();
+}
+
+qint64 SettingsDialog::undoMemoryLimit() const
+{
+    // the spin box is in megabytes
+    QSpinBox* qsb = findChild<QSpinBox*>("undoMemoryLimit");
+    return qint64(qsb->value()) * 1024 * 1024;
+}
+
+int SettingsDialog::undoMergeInterval() const
+{
+    QSpinBox* qsb = findChild<QSpinBox*>("undoMergeInterval");
+    return qsb->value();
+}
+
 QString SettingsDialog::sourceLangDict() const
 {
     QLineEdit* qle = findChild<QLineEdit*>("slDictPath");
@@ -79,6 +105,10 @@ void SettingsDialog::updateValues(FileTab *tab)
     QLineEdit* sldict = findChild<QLineEdit*>("slDictPath");
     QLineEdit* tldict = findChild<QLineEdit*>("tlDictPath");
     QLineEdit* bidict = findChild<QLineEdit*>("bilinDictPath");
+    QSpinBox* jobs = findChild<QSpinBox*>("toolJobs");
+    QSpinBox* undoLimit = findChild<QSpinBox*>("undoLimit");
+    QSpinBox* undoMemory = findChild<QSpinBox*>("undoMemoryLimit");
+    QSpinBox* undoMerge = findChild<QSpinBox*>("undoMergeInterval");
 
     QPushButton* slbtn = findChild<QPushButton*>("browseSlDict");
     QPushButton* tlbtn = findChild<QPushButton*>("browseTlDict");
@@ -106,6 +136,11 @@ void SettingsDialog::updateValues(FileTab *tab)
     ltproc->setText(appConfig().ltProcPath());
     ltcomp->setText(appConfig().ltCompPath());
     apert->setText(appConfig().apertiumTransferPath());
+    jobs->setValue(appConfig().toolJobs());
+    undoLimit->setValue(appConfig().undoLimit());
+    // rounded up, so that a limit isn't turned off by rounding it to 0
+    undoMemory->setValue(int((appConfig().undoMemoryLimit() + 1024*1024 - 1) / (1024*1024)));
+    undoMerge->setValue(appConfig().undoMergeInterval());
 }
 
 void SettingsDialog::setDictPath(const QString &entry)
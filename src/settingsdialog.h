@@ -38,6 +38,11 @@ public:
     QString ltComp() const;
     QString apertiumTransfer() const;
     QString apertiumPreprocTrans() const;
+    int toolJobs() const;
+    // 0 if undo steps aren't limited by number or memory
+    int undoLimit() const;
+    qint64 undoMemoryLimit() const;
+    int undoMergeInterval() const;
 
     QString sourceLangDict() const;
     QString targetLangDict() const;
@@ -0,0 +1,264 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "symbolstrip.h"
+#include "diagram.h"
+#include "config.h"
+#include "action.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+namespace
+{
+const int maxWidth = 360;
+const int chipSpacing = 4;
+const int chipPadding = 6;
+
+QString plainLabel(const QString& str)
+{
+    QString res = str;
+    res.replace("&lt;", "<");
+    res.replace("&gt;", ">");
+    res.replace("&amp;", "&");
+    return res;
+}
+}
+
+SymbolStrip::SymbolStrip(Box *parent)
+    : QWidget(parent)
+    , box_(parent)
+    , data_(parent->data())
+    , chips_()
+    , add_()
+    , size_()
+{
+    setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+    connect(data_, SIGNAL(childInserted(Node*,int)), this, SLOT(symbolsChanged()));
+    connect(data_, SIGNAL(childRemoved(Node*)), this, SLOT(symbolsChanged()));
+    layoutChips();
+}
+
+void SymbolStrip::layoutChips()
+{
+    const FileConfiguration& conf = fileConfig(data_->filePath());
+    QFontMetrics fm(font());
+    const int h = fm.height() + 4;
+    const int closeWidth = fm.width("x") + 4;
+
+    chips_.clear();
+    foreach (Node* n, data_->children()) {
+        if (!isSymbol(n->name())) {
+            continue;
+        }
+
+        VisualSchema::Tag tdef = conf.tag(n->name());
+        Chip chip;
+        chip.node = n;
+        chip.text = plainLabel(tdef.label);
+        chip.color = tdef.boxColor;
+        chip.rect = QRect(0, 0, fm.width(chip.text) + 2*chipPadding + closeWidth, h);
+        chips_.append(chip);
+    }
+
+    // flow the chips into rows no wider than maxWidth, the "+" chip last
+    int x = 0;
+    int y = 0;
+    int right = 0;
+    for (int i = 0; i<chips_.size(); i++) {
+        Chip& chip = chips_[i];
+        if (x > 0 && x + chip.rect.width() > maxWidth) {
+            x = 0;
+            y += h + chipSpacing;
+        }
+        chip.rect.moveTo(x, y);
+        chip.close = QRect(chip.rect.right() - closeWidth - chipPadding/2, y, closeWidth, h);
+        x += chip.rect.width() + chipSpacing;
+        right = qMax(right, chip.rect.right());
+    }
+
+    const int addWidth = fm.width("+") + 2*chipPadding;
+    if (x > 0 && x + addWidth > maxWidth) {
+        x = 0;
+        y += h + chipSpacing;
+    }
+    add_ = QRect(x, y, addWidth, h);
+    right = qMax(right, add_.right());
+
+    size_ = QSize(right + 1, y + h + 1);
+    updateGeometry();
+    update();
+}
+
+void SymbolStrip::symbolsChanged()
+{
+    layoutChips();
+    box_->updateLayout();
+}
+
+void SymbolStrip::paintEvent(QPaintEvent *ev)
+{
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    const QRect clip = ev->rect();
+
+    foreach (const Chip& chip, chips_) {
+        if (!chip.rect.intersects(clip)) {
+            continue;
+        }
+
+        painter.setPen(QPen(Qt::black, 1));
+        painter.setBrush(chip.color);
+        painter.drawRoundedRect(chip.rect, 4, 4);
+
+        painter.setPen(qGray(chip.color.rgb()) < 128 ? Qt::white : appearance::fontColor());
+        painter.drawText(chip.rect.adjusted(chipPadding, 0, -chip.close.width() - chipPadding, 0),
+                         Qt::AlignLeft | Qt::AlignVCenter, chip.text);
+        painter.drawText(chip.close, Qt::AlignCenter, "x");
+    }
+
+    painter.setPen(QPen(Qt::black, 1));
+    painter.setBrush(Qt::white);
+    painter.drawRoundedRect(add_, 4, 4);
+    painter.setPen(appearance::fontColor());
+    painter.drawText(add_, Qt::AlignCenter, "+");
+}
+
+void SymbolStrip::mousePressEvent(QMouseEvent *ev)
+{
+    if (ev->button() != Qt::LeftButton) {
+        ev->ignore();
+        return;
+    }
+
+    if (add_.contains(ev->pos())) {
+        showPicker();
+        return;
+    }
+
+    foreach (const Chip& chip, chips_) {
+        if (chip.close.contains(ev->pos())) {
+            box_->actionStack().push(new actions::RemoveNode(chip.node));
+            return;
+        }
+    }
+
+    // let the box handle selection and dragging
+    ev->ignore();
+}
+
+void SymbolStrip::showPicker()
+{
+    VisualSchema::Tag tdef = fileConfig(data_->filePath()).tag(data_->name());
+
+    QStringList present;
+    foreach (const Chip& chip, chips_) {
+        present.append(chip.node->name());
+    }
+
+    QStringList symbols;
+    foreach (const QString& name, tdef.children) {
+        if (isSymbol(name) && !present.contains(name)) {
+            symbols.append(name);
+        }
+    }
+
+    SymbolPicker picker(symbols, this);
+    connect(&picker, SIGNAL(symbolsChosen(QStringList)), this, SLOT(addSymbols(QStringList)));
+    picker.move(mapToGlobal(add_.bottomLeft()));
+    picker.exec();
+}
+
+void SymbolStrip::addSymbol(const QString &name)
+{
+    Node* n = Node::create(name, true, data_);
+    box_->actionStack().push(new actions::InsertNode(n, data_, data_->children().size()));
+}
+
+void SymbolStrip::addSymbols(const QStringList &names)
+{
+    ActionStack& stack = box_->actionStack();
+    stack.beginTransaction();
+    foreach (const QString& name, names) {
+        addSymbol(name);
+    }
+    stack.commitTransaction();
+}
+
+SymbolPicker::SymbolPicker(const QStringList &symbols, QWidget *parent)
+    : QDialog(parent, Qt::Popup)
+    , filter_(new QLineEdit(this))
+    , list_(new QListWidget(this))
+{
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(2, 2, 2, 2);
+    layout->addWidget(filter_);
+    layout->addWidget(list_);
+
+    foreach (const QString& name, symbols) {
+        QListWidgetItem* item = new QListWidgetItem(name.mid(QString("__symbol_").size()), list_);
+        item->setData(Qt::UserRole, name);
+    }
+
+    list_->setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    connect(filter_, SIGNAL(textChanged(QString)), this, SLOT(filter(QString)));
+    connect(filter_, SIGNAL(returnPressed()), this, SLOT(chooseSelected()));
+    connect(list_, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(chooseSelected()));
+
+    filter_->setFocus();
+}
+
+void SymbolPicker::filter(const QString &str)
+{
+    QListWidgetItem* first = NULL;
+    for (int i = 0; i<list_->count(); i++) {
+        QListWidgetItem* item = list_->item(i);
+        bool match = item->text().contains(str, Qt::CaseInsensitive);
+        item->setHidden(!match);
+        if (match && first == NULL) {
+            first = item;
+        }
+    }
+
+    list_->setCurrentItem(first);
+}
+
+void SymbolPicker::chooseSelected()
+{
+    QList<QListWidgetItem*> items = list_->selectedItems();
+    if (items.isEmpty() && list_->currentItem() != NULL) {
+        items.append(list_->currentItem());
+    }
+
+    QStringList names;
+    foreach (QListWidgetItem* item, items) {
+        if (!item->isHidden()) {
+            names.append(item->data(Qt::UserRole).toString());
+        }
+    }
+
+    if (!names.isEmpty()) {
+        emit symbolsChosen(names);
+        accept();
+    }
+}
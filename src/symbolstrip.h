@@ -0,0 +1,100 @@
+/*
+    Copyright (c) 2013 Boldizsár Lipka <lipkab@zoho.com>
+
+    This file is part of the Apertium Visual Rule Editor.
+
+    Apertium Visual Rule Editor is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Apertium Visual Rule Editor is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Apertium Visual Rule Editor.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYMBOLSTRIP_H
+#define SYMBOLSTRIP_H
+
+#include <QWidget>
+#include <QDialog>
+#include <QVector>
+#include <QColor>
+#include <QStringList>
+#include "node.h"
+
+class Box;
+class QLineEdit;
+class QListWidget;
+class QListWidgetItem;
+
+// Shows the __symbol_* children of a cat-item or def-attr as a strip of
+// painted chips, instead of a box for every symbol. Symbols are removed with
+// the cross on their chip and added with the picker behind the "+" chip.
+class SymbolStrip : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SymbolStrip(Box* parent);
+
+    static bool isSymbol(const QString& name) { return name.startsWith("__symbol_"); }
+
+    QSize sizeHint() const { return size_; }
+    QSize minimumSizeHint() const { return size_; }
+
+public slots:
+    void showPicker();
+    void addSymbol(const QString& name);
+    void addSymbols(const QStringList& names);
+
+protected:
+    void paintEvent(QPaintEvent* ev);
+    void mousePressEvent(QMouseEvent* ev);
+
+private slots:
+    void symbolsChanged();
+
+private:
+    struct Chip
+    {
+        Node* node;
+        QString text;
+        QColor color;
+        QRect rect;
+        QRect close;
+    };
+
+    void layoutChips();
+
+    Box* box_;
+    Node* data_;
+    QVector<Chip> chips_;
+    QRect add_;
+    QSize size_;
+};
+
+// Filterable list of the symbols which can still be added to a container,
+// several of them can be picked at once.
+class SymbolPicker : public QDialog
+{
+    Q_OBJECT
+public:
+    SymbolPicker(const QStringList& symbols, QWidget* parent = NULL);
+
+signals:
+    void symbolsChosen(const QStringList& names);
+
+private slots:
+    void filter(const QString& str);
+    void chooseSelected();
+
+private:
+    QLineEdit* filter_;
+    QListWidget* list_;
+};
+
+#endif // SYMBOLSTRIP_H
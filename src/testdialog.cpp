@@ -19,6 +19,10 @@
 
 #include "testdialog.h"
 #include "ui_testdialog.h"
+#include "corpus.h"
+#include "config.h"
+#include <QFileDialog>
+#include <QElapsedTimer>
 
 namespace {
 void stripTrailingWhiteSpace(QString& str) {
@@ -37,9 +41,13 @@ void stripTrailingWhiteSpace(QString& str) {
 TestDialog::TestDialog(QWidget *parent) :
     QDialog(parent),
     ui(new Ui::TestDialog),
-    tools_(NULL)
+    tools_(NULL),
+    interpreter_(NULL),
+    job_(-1),
+    corpus_(NULL)
 {
     ui->setupUi(this);
+    setRunning(false);
 }
 
 TestDialog::~TestDialog()
@@ -50,53 +58,146 @@ TestDialog::~TestDialog()
 void TestDialog::setTools(ToolsManager *tm)
 {
     if (tools_ != NULL) {
-        disconnect(tools_, SIGNAL(morphFinished(QString)), this, SLOT(morphFinished(QString)));
-        disconnect(tools_, SIGNAL(transferFinished(QString)), this, SLOT(transferFinished(QString)));
-        disconnect(tools_, SIGNAL(generateFinished(QString)), this, SLOT(generateFinished(QString)));
+        disconnect(tools_, SIGNAL(testOutput(QString)), this, SLOT(testOutput(QString)));
+        disconnect(tools_, SIGNAL(jobProgress(int,int,int)), this, SLOT(testProgress(int,int,int)));
+        disconnect(tools_, SIGNAL(testFinished()), this, SLOT(testFinished()));
+        disconnect(tools_, SIGNAL(testFailed(QString)), this, SLOT(testFailed(QString)));
     }
 
+    // the runner uses the commands of the old tools
+    delete corpus_;
+    corpus_ = NULL;
     tools_ = tm;
 
     if (tools_ != NULL) {
-        connect(tools_, SIGNAL(morphFinished(QString)), this, SLOT(morphFinished(QString)));
-        connect(tools_, SIGNAL(transferFinished(QString)), this, SLOT(transferFinished(QString)));
-        connect(tools_, SIGNAL(generateFinished(QString)), this, SLOT(generateFinished(QString)));
+        connect(tools_, SIGNAL(testOutput(QString)), this, SLOT(testOutput(QString)));
+        connect(tools_, SIGNAL(jobProgress(int,int,int)), this, SLOT(testProgress(int,int,int)));
+        connect(tools_, SIGNAL(testFinished()), this, SLOT(testFinished()));
+        connect(tools_, SIGNAL(testFailed(QString)), this, SLOT(testFailed(QString)));
     }
 }
 
+ToolsManager::Stage TestDialog::selectedStage() const
+{
+    if (findChild<QRadioButton*>("morfRadio")->isChecked()) {
+        return ToolsManager::MORPH;
+    } else if (findChild<QRadioButton*>("transferRadio")->isChecked() || findChild<QRadioButton*>("builtinRadio")->isChecked()) {
+        return ToolsManager::TRANSFER;
+    }
+
+    return ToolsManager::GENERATE;
+}
+
 void TestDialog::on_goButton_pressed()
 {
     QPlainTextEdit* in = findChild<QPlainTextEdit*>("input");
-    tools_->morph(in->toPlainText());
+    findChild<QPlainTextEdit*>("output")->clear();
+
+    // the rules in the editor, run right away on analysed text
+    if (findChild<QRadioButton*>("builtinRadio")->isChecked()) {
+        if (interpreter_ == NULL) {
+            return;
+        }
+
+        QString out, error;
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = interpreter_->run(in->toPlainText(), out, &error);
+        const qint64 usecs = timer.nsecsElapsed() / 1000;
+        if (!ok) {
+            testFailed(error);
+            return;
+        }
+
+        testOutput(out);
+        findChild<QLabel*>("label_2")->setText(tr("Result: (%1 ms)").arg(usecs / 1000.0, 0, 'f', 3));
+        return;
+    }
+
+    job_ = tools_->test(in->toPlainText(), selectedStage());
+    setRunning(tools_->isTesting());
 }
 
-void TestDialog::morphFinished(QString str)
+void TestDialog::on_cancelButton_pressed()
 {
-    QRadioButton* radio = findChild<QRadioButton*>("morfRadio");
-    if (radio->isChecked()) {
-        QPlainTextEdit* out = findChild<QPlainTextEdit*>("output");
-        stripTrailingWhiteSpace(str);
-        out->setPlainText(str);
-    } else {
-        tools_->transfer(str);
+    if (corpus_ != NULL && corpus_->isRunning()) {
+        corpus_->cancel();
+        return;
     }
+
+    tools_->cancelTest();
+    setRunning(false);
 }
 
-void TestDialog::transferFinished(QString str)
+void TestDialog::on_corpusButton_pressed()
 {
-    QRadioButton* radio = findChild<QRadioButton*>("transferRadio");
-    if (radio->isChecked()) {
-        QPlainTextEdit* out = findChild<QPlainTextEdit*>("output");
-        stripTrailingWhiteSpace(str);
-        out->setPlainText(str);
-    } else {
-        tools_->generate(str);
+    QString path = QFileDialog::getOpenFileName(this, tr("Run corpus"), QString(), tr("Corpus (*.txt *.tsv);;All files (*)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    if (corpus_ == NULL) {
+        corpus_ = new CorpusRunner(tools_, this);
+        connect(corpus_, SIGNAL(progress(int,int)), this, SLOT(corpusProgress(int,int)));
+        connect(corpus_, SIGNAL(finished()), this, SLOT(corpusFinished()));
+    }
+
+    QPlainTextEdit* out = findChild<QPlainTextEdit*>("output");
+    if (!corpus_->load(path)) {
+        out->setPlainText(tr("Can't read %1").arg(path));
+        return;
     }
+
+    out->clear();
+    setRunning(true);
+    corpus_->setLastStage(selectedStage());
+    corpus_->start(appConfig().toolJobs());
+}
+
+void TestDialog::corpusProgress(int done, int total)
+{
+    findChild<QLabel*>("label_2")->setText(tr("Result: (%1/%2 sentences)").arg(done).arg(total));
+}
+
+void TestDialog::corpusFinished()
+{
+    findChild<QPlainTextEdit*>("output")->setPlainText(corpus_->report());
+    setRunning(false);
 }
 
-void TestDialog::generateFinished(QString str)
+void TestDialog::testOutput(QString str)
 {
     QPlainTextEdit* out = findChild<QPlainTextEdit*>("output");
     stripTrailingWhiteSpace(str);
-    out->setPlainText(str);
+    out->appendPlainText(str);
+}
+
+void TestDialog::testProgress(int job, int done, int total)
+{
+    if (job == job_) {
+        findChild<QLabel*>("label_2")->setText(tr("Result: (%1/%2 lines)").arg(done).arg(total));
+    }
+}
+
+void TestDialog::testFinished()
+{
+    setRunning(false);
+}
+
+void TestDialog::testFailed(QString error)
+{
+    QPlainTextEdit* out = findChild<QPlainTextEdit*>("output");
+    stripTrailingWhiteSpace(error);
+    out->setPlainText(error);
+    setRunning(false);
+}
+
+void TestDialog::setRunning(bool running)
+{
+    if (!running) {
+        findChild<QLabel*>("label_2")->setText(tr("Result:"));
+    }
+    findChild<QPushButton*>("goButton")->setEnabled(!running);
+    findChild<QPushButton*>("corpusButton")->setEnabled(!running);
+    findChild<QPushButton*>("cancelButton")->setEnabled(running);
 }
@@ -23,6 +23,9 @@
 
 #include <QDialog>
 #include "tools.h"
+#include "interpreter.h"
+
+class CorpusRunner;
 
 namespace Ui {
 class TestDialog;
@@ -38,18 +41,31 @@ public:
 
     void setTools(ToolsManager* tm);
     ToolsManager* tools() const { return tools_; }
+    void setInterpreter(TransferInterpreter* ti) { interpreter_ = ti; }
 
 public slots:
     void on_goButton_pressed();
+    void on_cancelButton_pressed();
+    // runs a corpus file, see CorpusRunner
+    void on_corpusButton_pressed();
     
 private slots:
-    void morphFinished(QString str);
-    void transferFinished(QString str);
-    void generateFinished(QString str);
+    void testOutput(QString str);
+    void testProgress(int job, int done, int total);
+    void testFinished();
+    void testFailed(QString error);
+    void corpusProgress(int done, int total);
+    void corpusFinished();
 
 private:
+    ToolsManager::Stage selectedStage() const;
+    void setRunning(bool running);
+
     Ui::TestDialog *ui;
     ToolsManager* tools_;
+    TransferInterpreter* interpreter_;
+    int job_;
+    CorpusRunner* corpus_;
 };
 
 #endif // TESTDIALOG_H
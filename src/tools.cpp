@@ -20,186 +20,696 @@
 #include "tools.h"
 #include "config.h"
 #include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+
+ToolWorker::ToolWorker(QObject *parent)
+    : QObject(parent)
+    , commands_()
+    , binaries_()
+    , modified_()
+    , procs_()
+    , buffer_()
+    , errors_()
+    , tags_()
+    , restartPending_(false)
+{}
+
+ToolWorker::~ToolWorker()
+{
+    stop();
+}
+
+void ToolWorker::setCommands(const QList<Command> &commands, const QStringList &binaries)
+{
+    if (commands == commands_ && binaries == binaries_) {
+        return;
+    }
+
+    commands_ = commands;
+    binaries_ = binaries;
+    restart();
+}
 
-void ToolsManager::morph(const QString &text)
+void ToolWorker::request(const QString &text, int tag)
 {
-    if (!canLaunchNew()) {
+    if (!procs_.isEmpty() && !isBusy() && binariesChanged()) {
+        stop();
+    }
+
+    // queued first, so that failing to start is reported for it
+    tags_.append(tag);
+    if (!ensureStarted()) {
         return;
     }
 
-    curProc_ = new QProcess;
-    curType_ = MORPH;
-    connect(curProc_, SIGNAL(readyReadStandardOutput()), this, SLOT(outputReady()));
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    QProcess* first = procs_.first();
+    first->write(text.toUtf8());
+    first->write("\n");
+    first->putChar(0);
+}
 
-    curProc_->start(appConfig().ltProcPath(), QStringList() << slbin_ << "-z");
-    curProc_->write(text.toLatin1());
-    curProc_->write("\n");
-    curProc_->putChar(0);
+void ToolWorker::restart()
+{
+    if (!isBusy()) {
+        stop();
+    } else {
+        restartPending_ = true;
+    }
 }
 
-void ToolsManager::transfer(const QString &text)
+bool ToolWorker::ensureStarted()
 {
-    if (!canLaunchNew()) {
+    if (!procs_.isEmpty()) {
+        return true;
+    }
+
+    foreach (const Command& c, commands_) {
+        Q_UNUSED(c);
+        QProcess* proc = new QProcess(this);
+        connect(proc, SIGNAL(readyReadStandardError()), this, SLOT(readErrors()));
+        connect(proc, SIGNAL(finished(int)), this, SLOT(processFinished()));
+        connect(proc, SIGNAL(error(QProcess::ProcessError)), this, SLOT(processError()));
+        if (!procs_.isEmpty()) {
+            procs_.last()->setStandardOutputProcess(proc);
+        }
+        procs_.append(proc);
+    }
+    connect(procs_.last(), SIGNAL(readyReadStandardOutput()), this, SLOT(readOutput()));
+
+    modified_.clear();
+    foreach (const QString& bin, binaries_) {
+        modified_.append(QFileInfo(bin).lastModified());
+    }
+
+    // a failure to start stops the worker right away
+    for (int i = 0; i<commands_.size() && !procs_.isEmpty(); i++) {
+        procs_[i]->start(commands_[i].program, commands_[i].args);
+    }
+
+    return !procs_.isEmpty();
+}
+
+bool ToolWorker::binariesChanged() const
+{
+    for (int i = 0; i<binaries_.size(); i++) {
+        if (QFileInfo(binaries_[i]).lastModified() != modified_.value(i)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ToolWorker::readOutput()
+{
+    buffer_ += procs_.last()->readAllStandardOutput();
+
+    int nul;
+    while (isBusy() && (nul = buffer_.indexOf('\0')) != -1) {
+        QString out = QString::fromUtf8(buffer_.constData(), nul);
+        buffer_.remove(0, nul + 1);
+        emit answered(out, tags_.takeFirst());
+    }
+
+    if (!isBusy() && restartPending_) {
+        stop();
+    }
+}
+
+void ToolWorker::readErrors()
+{
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    if (proc == NULL) {
+        return;
+    }
+
+    const int keep = 4096;
+    errors_ += proc->readAllStandardError();
+    if (errors_.size() > keep) {
+        errors_.remove(0, errors_.size() - keep);
+    }
+}
+
+void ToolWorker::processFinished()
+{
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    int i = procs_.indexOf(proc);
+    if (i == -1) {
         return;
     }
 
-    curProc_ = new QProcess;
-    curType_ = TRANSFER;
-    connect(curProc_, SIGNAL(readyReadStandardOutput()), this, SLOT(outputReady()));
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    errors_ += proc->readAllStandardError();
+    fail(commands_[i].program + ": " + QString::fromLocal8Bit(errors_));
+}
 
-    //FIXME
-    QString cmd = "echo \"" + text + "\" |" + appConfig().apertiumTransferPath() + " " + rules_ + " " + rulebin_ + " " + bibin_;
-    curProc_->start("/bin/bash", QStringList() << "-c" << cmd);
+void ToolWorker::processError()
+{
+    // a crash is followed by finished()
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    int i = procs_.indexOf(proc);
+    if (i != -1 && proc->error() == QProcess::FailedToStart) {
+        fail(commands_[i].program + ": " + proc->errorString());
+    }
+}
+
+void ToolWorker::fail(const QString &error)
+{
+    const QList<int> lost = tags_;
+    stop();
+    foreach (int tag, lost) {
+        emit failed(error, tag);
+    }
 }
 
-void ToolsManager::generate(const QString &text)
+void ToolWorker::stop()
 {
-    if (!canLaunchNew()) {
+    tags_.clear();
+    restartPending_ = false;
+    buffer_.clear();
+    errors_.clear();
+
+    if (procs_.isEmpty()) {
         return;
     }
 
-    curProc_ = new QProcess;
-    curType_ = GENERATE;
-    connect(curProc_, SIGNAL(readyReadStandardOutput()), this, SLOT(outputReady()));
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    // closing the input of the first stage ends the whole pipeline
+    QList<QProcess*> procs = procs_;
+    procs_.clear();
+    foreach (QProcess* proc, procs) {
+        proc->disconnect(this);
+    }
+    procs.first()->closeWriteChannel();
+    foreach (QProcess* proc, procs) {
+        if (proc->state() != QProcess::NotRunning && !proc->waitForFinished(500)) {
+            proc->kill();
+            proc->waitForFinished(500);
+        }
+        proc->deleteLater();
+    }
+}
+
+ToolWorker* ToolsManager::worker(ToolWorker *&w, const char *answered)
+{
+    if (w == NULL) {
+        w = new ToolWorker(this);
+        connect(w, SIGNAL(answered(QString,int)), this, answered);
+        connect(w, SIGNAL(failed(QString,int)), this, SLOT(workerFailed(QString,int)));
+    }
+
+    return w;
+}
+
+bool ToolsManager::hasJob(Job::Kind kind) const
+{
+    foreach (const Job& j, jobs_) {
+        if (j.kind == kind) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ToolsManager::Job* ToolsManager::job(int id)
+{
+    for (int i = 0; i<jobs_.size(); i++) {
+        if (jobs_[i].id == id) {
+            return &jobs_[i];
+        }
+    }
+
+    return NULL;
+}
+
+int ToolsManager::enqueue(const Job &job)
+{
+    int i = 0;
+    while (i < jobs_.size() && jobs_[i].priority >= job.priority) {
+        i++;
+    }
+    jobs_.insert(i, job);
+    schedule();
+
+    return job.id;
+}
 
-    QString cmd = "echo \"" + text + "\" |" + appConfig().ltProcPath() + " -gz " + tlbin_;
-    curProc_->start("/bin/bash", QStringList() << "-c" << cmd);
+int ToolsManager::freeSlots(Job::Kind kind) const
+{
+    // a test always has a slot of its own, so it never waits for a compile
+    // step that may take minutes; with more than one slot the steps leave
+    // one for it
+    if (kind == Job::TEST) {
+        return testJob_ == -1 ? 1 : 0;
+    }
+
+    const int jobs = qMax(1, appConfig().toolJobs());
+    int used = 0;
+    foreach (const CompileStep& s, steps_) {
+        if (s.state == CompileStep::RUNNING) {
+            used++;
+        }
+    }
+
+    return (jobs > 1 ? jobs - 1 : 1) - used;
 }
 
-void ToolsManager::compile()
+void ToolsManager::schedule()
 {
-    if (!canLaunchNew()) {
+    // starting a job may finish it right away, which schedules again
+    if (scheduling_) {
         return;
     }
+    scheduling_ = true;
+
+    bool started = true;
+    while (started) {
+        started = false;
+        for (int i = 0; i<jobs_.size(); i++) {
+            Job& j = jobs_[i];
+            if (j.running || (j.kind == Job::TEST ? testJob_ : compileJob_) != -1 || freeSlots(j.kind) <= 0) {
+                continue;
+            }
+
+            j.running = true;
+            emit jobStarted(j.id);
+            if (j.kind == Job::TEST) {
+                startTest(j);
+            } else {
+                startCompile(j);
+            }
+            started = true;
+            break;
+        }
+    }
+
+    // the steps of a running compilation take the slots left
+    if (compiling_) {
+        startCompileSteps();
+    }
+
+    scheduling_ = false;
+}
+
+void ToolsManager::progress(int id, int done, int total)
+{
+    Job* j = job(id);
+    if (j != NULL) {
+        j->done = done;
+        j->total = total;
+        emit jobProgress(id, done, total);
+    }
+}
+
+void ToolsManager::finishJob(int id, bool successful)
+{
+    for (int i = 0; i<jobs_.size(); i++) {
+        if (jobs_[i].id == id) {
+            jobs_.removeAt(i);
+            break;
+        }
+    }
+    if (compileJob_ == id) {
+        compileJob_ = -1;
+    }
+    if (testJob_ == id) {
+        testJob_ = -1;
+    }
+
+    emit jobFinished(id, successful);
+    schedule();
+}
+
+int ToolsManager::test(const QString &text, Stage last)
+{
+    cancelTest();
+
+    Job j(nextJob_++, Job::TEST);
+    j.text = text;
+    j.stage = last;
+    return enqueue(j);
+}
+
+void ToolsManager::cancelTest()
+{
+    // the lines already given to the tools are still processed, but their
+    // results are dropped
+    testRun_++;
+    testInput_.clear();
+    inFlight_ = 0;
+
+    QList<int> canceled;
+    foreach (const Job& j, jobs_) {
+        if (j.kind == Job::TEST) {
+            canceled.append(j.id);
+        }
+    }
+    foreach (int id, canceled) {
+        finishJob(id, false);
+    }
+}
 
-    curProc_ = new QProcess(this);
-    curType_ = COMPILE1;
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+void ToolsManager::startTest(const Job &job)
+{
+    testJob_ = job.id;
+    testStage_ = job.stage;
+    testInput_ = job.text.split('\n');
+    progress(job.id, 0, testInput_.size());
+    feedTest();
+}
 
-    QStringList args;
-    args.append("lr");
-    args.append(sldict_);
-    args.append(slbin_);
+void ToolsManager::feedTest()
+{
+    // backpressure: a long text is given to the analyser a few lines at a
+    // time, more are written as the results come back
+    const int maxLines = 16;
+    const qint64 maxBuffered = 64*1024;
+
+    ToolWorker* w = worker(morphWorker_, SLOT(morphAnswered(QString,int)));
+    w->setCommand(stageCommand(MORPH), stageBinaries(MORPH));
+    while (!testInput_.isEmpty() && inFlight_ < maxLines && w->bytesToWrite() < maxBuffered) {
+        inFlight_++;
+        w->request(testInput_.takeFirst(), testRun_);
+    }
+}
+
+void ToolsManager::deliverTest(const QString &out)
+{
+    inFlight_--;
+    emit testOutput(out);
 
-    curProc_->start(appConfig().ltCompPath(), args);
+    Job* j = job(testJob_);
+    if (j != NULL) {
+        progress(j->id, j->done + 1, j->total);
+    }
+
+    if (inFlight_ > 0 || !testInput_.isEmpty()) {
+        feedTest();
+    } else {
+        emit testFinished();
+        finishJob(testJob_, true);
+    }
 }
 
-void ToolsManager::compile2()
+void ToolsManager::morphAnswered(const QString &answer, int run)
 {
-    if (!canLaunchNew()) {
+    if (run != testRun_) {
         return;
     }
 
-    curProc_ = new QProcess(this);
-    curType_ = COMPILE2;
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    const QString out = stripSurfaceForms(answer);
+    if (testStage_ == MORPH) {
+        deliverTest(out);
+        return;
+    }
 
-    QStringList args;
-    args.append("rl");
-    args.append(tldict_);
-    args.append(tlbin_);
+    if (testStage_ == TRANSFER) {
+        ToolWorker* w = worker(transferWorker_, SLOT(stageAnswered(QString,int)));
+        w->setCommand(stageCommand(TRANSFER), stageBinaries(TRANSFER));
+        w->request(out, run);
+    } else {
+        ToolWorker* w = worker(generateWorker_, SLOT(stageAnswered(QString,int)));
+        w->setCommands(QList<ToolWorker::Command>() << stageCommand(TRANSFER) << stageCommand(GENERATE),
+                       stageBinaries(TRANSFER) + stageBinaries(GENERATE));
+        w->request(out, run);
+    }
+}
 
-    curProc_->start(appConfig().ltCompPath(), args);
+ToolWorker::Command ToolsManager::stageCommand(Stage stage) const
+{
+    switch (stage) {
+    case MORPH:
+        return ToolWorker::Command(appConfig().ltProcPath(), QStringList() << "-z" << slbin_);
+    case TRANSFER:
+        return ToolWorker::Command(appConfig().apertiumTransferPath(), QStringList() << "-z" << rules_ << rulebin_ << bibin_);
+    default:
+        return ToolWorker::Command(appConfig().ltProcPath(), QStringList() << "-gz" << tlbin_);
+    }
+}
+
+QStringList ToolsManager::stageBinaries(Stage stage) const
+{
+    switch (stage) {
+    case MORPH:
+        return QStringList() << slbin_;
+    case TRANSFER:
+        return QStringList() << rulebin_ << bibin_;
+    default:
+        return QStringList() << tlbin_;
+    }
+}
+
+QString ToolsManager::stripSurfaceForms(const QString &analyses)
+{
+    QString out = analyses;
+    int lustart = out.indexOf("^");
+    while (lustart != -1) {
+        int sep = out.indexOf("/", lustart);
+        out.remove(lustart+1, sep-lustart);
+        lustart = out.indexOf("^", lustart+1);
+    }
+
+    return out;
 }
 
-void ToolsManager::compile3()
+void ToolsManager::stageAnswered(const QString &out, int run)
 {
-    if (!canLaunchNew()) {
+    if (run == testRun_) {
+        deliverTest(out);
+    }
+}
+
+void ToolsManager::workerFailed(const QString &error, int run)
+{
+    if (run != testRun_) {
         return;
     }
 
-    curProc_ = new QProcess(this);
-    curType_ = COMPILE3;
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    const int id = testJob_;
+    testRun_++;
+    testInput_.clear();
+    inFlight_ = 0;
+    emit testFailed(error);
+    finishJob(id, false);
+}
 
-    QStringList args;
-    args.append("lr");
-    args.append(bidict_);
-    args.append(bibin_);
+int ToolsManager::compile()
+{
+    foreach (const Job& j, jobs_) {
+        if (j.kind == Job::COMPILE && !j.running) {
+            return j.id;
+        }
+    }
 
-    curProc_->start(appConfig().ltCompPath(), args);
+    return enqueue(Job(nextJob_++, Job::COMPILE));
 }
 
-void ToolsManager::compile4()
+void ToolsManager::startCompile(const Job &job)
 {
-    if (!canLaunchNew()) {
+    compileJob_ = job.id;
+    steps_.clear();
+    steps_.append(CompileStep(tr("Source language dictionary"), appConfig().ltCompPath(),
+                              QStringList() << "lr" << sldict_ << slbin_, sldict_, slbin_));
+    steps_.append(CompileStep(tr("Target language dictionary"), appConfig().ltCompPath(),
+                              QStringList() << "rl" << tldict_ << tlbin_, tldict_, tlbin_));
+    steps_.append(CompileStep(tr("Bilingual dictionary"), appConfig().ltCompPath(),
+                              QStringList() << "lr" << bidict_ << bibin_, bidict_, bibin_));
+    steps_.append(CompileStep(tr("Transfer rules"), appConfig().apertiumPreprocTransPath(),
+                              QStringList() << rules_ << rulebin_, rules_, rulebin_));
+
+    int waiting = 0;
+    for (int i = 0; i<steps_.size(); i++) {
+        CompileStep& s = steps_[i];
+        s.stamp = stampOf(s);
+
+        QFile stamp(stampPath(s));
+        if (QFile::exists(s.output) && stamp.open(QIODevice::ReadOnly) && stamp.readAll() == s.stamp) {
+            s.state = CompileStep::UP_TO_DATE;
+        } else {
+            waiting++;
+        }
+    }
+
+    if (waiting == 0) {
+        emit compileFinished(true);
+        finishJob(compileJob_, true);
         return;
     }
 
-    curProc_ = new QProcess(this);
-    curType_ = COMPILE4;
-    connect(curProc_, SIGNAL(finished(int)), this, SLOT(finished(int)));
+    compiling_ = true;
+    progress(compileJob_, steps_.size() - waiting, steps_.size());
+}
 
-    QStringList args;
-    args.append(rules_);
-    args.append(rulebin_);
+QByteArray ToolsManager::stampOf(const CompileStep &s)
+{
+    QByteArray res;
+    res += s.program.toUtf8() + "\n";
+    res += s.args.join("\t").toUtf8() + "\n";
+    res += fileHash(s.input).toHex() + "\n";
 
-    curProc_->start(appConfig().apertiumPreprocTransPath(), args);
+    return res;
 }
 
-void ToolsManager::outputReady()
+QByteArray ToolsManager::fileHash(const QString &path)
 {
-    curProc_->close();
+    QFileInfo fi(path);
+    if (!fi.exists()) {
+        return QByteArray();
+    }
+
+    FileHash& h = hashes_[fi.absoluteFilePath()];
+    if (h.size == fi.size() && h.modified == fi.lastModified()) {
+        return h.hash;
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&f);
+    h.size = fi.size();
+    h.modified = fi.lastModified();
+    h.hash = hash.result();
+
+    return h.hash;
 }
 
-void ToolsManager::finished(int retval)
+void ToolsManager::startCompileSteps()
 {
-    QString out = curProc_->readAllStandardOutput();
-    curProc_->deleteLater();
-    curProc_ = NULL;
+    for (int i = 0; i<steps_.size() && freeSlots(Job::COMPILE) > 0; i++) {
+        CompileStep& s = steps_[i];
+        if (s.state != CompileStep::WAITING) {
+            continue;
+        }
 
-    switch (curType_) {
-    case COMPILE1:
-        if (retval != 0) {
-            emit compileFinished(false);
-        } else {
-            compile2();
+        // the output is about to be overwritten
+        QFile::remove(stampPath(s));
+        QStringList args = s.args;
+        args.replace(args.indexOf(s.output), partPath(s));
+
+        s.proc = new QProcess(this);
+        s.state = CompileStep::RUNNING;
+        connect(s.proc, SIGNAL(finished(int)), this, SLOT(compileStepDone(int)));
+        connect(s.proc, SIGNAL(error(QProcess::ProcessError)), this, SLOT(compileStepError()));
+        s.timer.start();
+        s.proc->start(s.program, args);
+
+        emit compileStepStarted(i);
+    }
+}
+
+int ToolsManager::stepOf(QObject *proc) const
+{
+    for (int i = 0; i<steps_.size(); i++) {
+        if (steps_[i].proc == proc) {
+            return i;
         }
-        break;
-    case COMPILE2:
-        if (retval != 0) {
-            emit compileFinished(false);
-        } else {
-            compile3();
+    }
+
+    return -1;
+}
+
+void ToolsManager::compileStepDone(int retval)
+{
+    int i = stepOf(sender());
+    if (i == -1) {
+        return;
+    }
+
+    QProcess* proc = steps_[i].proc;
+    steps_[i].errors = QString::fromLocal8Bit(proc->readAllStandardError());
+    finishCompileStep(i, retval == 0 && proc->exitStatus() == QProcess::NormalExit);
+}
+
+void ToolsManager::compileStepError()
+{
+    // the other errors are followed by finished()
+    int i = stepOf(sender());
+    if (i == -1 || steps_[i].proc->error() != QProcess::FailedToStart) {
+        return;
+    }
+
+    steps_[i].errors = steps_[i].program + ": " + steps_[i].proc->errorString();
+    finishCompileStep(i, false);
+}
+
+void ToolsManager::finishCompileStep(int index, bool successful)
+{
+    CompileStep& s = steps_[index];
+    s.msecs = s.timer.elapsed();
+    s.state = successful ? CompileStep::SUCCEEDED : CompileStep::FAILED;
+    s.proc->disconnect(this);
+    s.proc->deleteLater();
+    s.proc = NULL;
+
+    if (successful) {
+        QFile::remove(s.output);
+        if (!QFile::rename(partPath(s), s.output)) {
+            s.errors = tr("Can't replace %1").arg(s.output);
+            s.state = CompileStep::FAILED;
+            successful = false;
         }
-        break;
-    case COMPILE3:
-        if (retval != 0) {
-            emit compileFinished(false);
-        } else {
-            compile4();
+    }
+
+    if (successful) {
+        QFile stamp(stampPath(s));
+        if (stamp.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            stamp.write(s.stamp);
         }
-        break;
-    case COMPILE4:
-        emit compileFinished(retval == 0);
-        break;
 
-    case MORPH:
-        {
-            int lustart = out.indexOf("^");
-            while (lustart != -1) {
-                int sep = out.indexOf("/", lustart);
-                out.remove(lustart+1, sep-lustart);
-                lustart = out.indexOf("^", lustart+1);
+        // the workers using the output have to load it again
+        foreach (ToolWorker* w, QList<ToolWorker*>() << morphWorker_ << transferWorker_ << generateWorker_) {
+            if (w != NULL && w->binaries().contains(s.output)) {
+                w->restart();
+            }
+        }
+    }
+    emit compileStepFinished(index);
+
+    if (!successful) {
+        // fail fast, the result is unusable anyway
+        QFile::remove(partPath(s));
+        for (int i = 0; i<steps_.size(); i++) {
+            CompileStep& other = steps_[i];
+            if (other.state == CompileStep::RUNNING) {
+                other.proc->disconnect(this);
+                other.proc->kill();
+                other.proc->waitForFinished(500);
+                other.proc->deleteLater();
+                other.proc = NULL;
+                other.msecs = other.timer.elapsed();
+                QFile::remove(partPath(other));
+            }
+            if (other.state == CompileStep::RUNNING || other.state == CompileStep::WAITING) {
+                other.state = CompileStep::CANCELED;
             }
-            emit morphFinished(out);
         }
-        break;
 
-    case GENERATE:
-        emit generateFinished(out);
-        break;
+        compiling_ = false;
+        emit compileFinished(false);
+        finishJob(compileJob_, false);
+        return;
+    }
 
-    case TRANSFER:
-        emit transferFinished(out);
-        break;
+    int done = 0;
+    foreach (const CompileStep& other, steps_) {
+        if (other.state == CompileStep::SUCCEEDED || other.state == CompileStep::UP_TO_DATE) {
+            done++;
+        }
+    }
+    progress(compileJob_, done, steps_.size());
 
-    default:
-        break;
+    if (done < steps_.size()) {
+        schedule();
+        return;
     }
+
+    compiling_ = false;
+    emit compileFinished(true);
+    finishJob(compileJob_, true);
 }
 
 QString ToolsManager::dirOfFile(const QString &str) const
@@ -23,6 +23,79 @@
 #include <QObject>
 #include <QList>
 #include <QProcess>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QDateTime>
+#include <QStringList>
+
+// A tool, or a pipeline of tools, kept running in null flush mode (-z), so
+// their binaries are loaded only once: every request written to the first
+// tool ends with a NUL, and so does the answer of the last one. The stages of
+// a pipeline are connected directly with QProcess::setStandardOutputProcess.
+// The processes are started on the first request and restarted when one of
+// the binaries changes. Requests carry a tag which is passed back with the
+// answer.
+class ToolWorker : public QObject
+{
+    Q_OBJECT
+public:
+    struct Command
+    {
+        Command(const QString& p = QString(), const QStringList& a = QStringList())
+            : program(p)
+            , args(a)
+        {}
+
+        bool operator ==(const Command& other) const { return program == other.program && args == other.args; }
+
+        QString program;
+        QStringList args;
+    };
+
+    ToolWorker(QObject* parent = NULL);
+    ~ToolWorker();
+
+    // restarts the worker if the commands are different
+    void setCommands(const QList<Command>& commands, const QStringList& binaries);
+    void setCommand(const Command& command, const QStringList& binaries) { setCommands(QList<Command>() << command, binaries); }
+    const QStringList& binaries() const { return binaries_; }
+
+    void request(const QString& text, int tag = 0);
+    bool isBusy() const { return !tags_.isEmpty(); }
+    // bytes written but not yet taken by the first tool
+    qint64 bytesToWrite() const { return procs_.isEmpty() ? 0 : procs_.first()->bytesToWrite(); }
+
+public slots:
+    // the processes are stopped once they have answered the pending requests
+    void restart();
+
+signals:
+    void answered(const QString& out, int tag);
+    void failed(const QString& error, int tag);
+
+private slots:
+    void readOutput();
+    void readErrors();
+    void processFinished();
+    void processError();
+
+private:
+    bool ensureStarted();
+    bool binariesChanged() const;
+    void stop();
+    void fail(const QString& error);
+
+    QList<Command> commands_;
+    QStringList binaries_;
+    QList<QDateTime> modified_;
+    QList<QProcess*> procs_;
+    QByteArray buffer_;
+    // the end of the standard error, it has to be drained continuously
+    QByteArray errors_;
+    // tags of the requests waiting for an answer
+    QList<int> tags_;
+    bool restartPending_;
+};
 
 class ToolsManager : public QObject
 {
@@ -38,8 +111,21 @@ public:
         , tlbin_(dirOfFile(tldict_) + "/tl.autogen.bin")
         , bibin_(dirOfFile(bidict_) + "/bilin.autobil.bin")
         , rulebin_(dirOfFile(rules_) + "/transfer.bin")
-        , curProc_(NULL)
-        , curType_(NONE)
+        , morphWorker_(NULL)
+        , transferWorker_(NULL)
+        , generateWorker_(NULL)
+        , testInput_()
+        , testStage_(MORPH)
+        , testRun_(0)
+        , inFlight_(0)
+        , jobs_()
+        , nextJob_(0)
+        , compileJob_(-1)
+        , testJob_(-1)
+        , scheduling_(false)
+        , steps_()
+        , compiling_(false)
+        , hashes_()
     {}
 
     ToolsManager(QObject* parent = NULL)
@@ -52,50 +138,201 @@ public:
         , tlbin_()
         , bibin_()
         , rulebin_()
-        , curProc_(NULL)
-        , curType_(NONE)
+        , morphWorker_(NULL)
+        , transferWorker_(NULL)
+        , generateWorker_(NULL)
+        , testInput_()
+        , testStage_(MORPH)
+        , testRun_(0)
+        , inFlight_(0)
+        , jobs_()
+        , nextJob_(0)
+        , compileJob_(-1)
+        , testJob_(-1)
+        , scheduling_(false)
+        , steps_()
+        , compiling_(false)
+        , hashes_()
     {}
 
-    bool canLaunchNew() const { return curProc_ == NULL; }
+    // The steps of a compilation don't depend on each other, so they run in
+    // parallel, in the tool slots they are given. The first
+    // failing step stops the others. A step is skipped if its output has a
+    // stamp file matching the tool, its arguments and the content of the
+    // input. The output is written next to the old one and renamed at the
+    // end, so that tests running meanwhile never load half a binary.
+    struct CompileStep
+    {
+        enum State { WAITING, RUNNING, SUCCEEDED, FAILED, CANCELED, UP_TO_DATE };
+
+        CompileStep(const QString& n, const QString& prog, const QStringList& a, const QString& in, const QString& out)
+            : name(n)
+            , program(prog)
+            , args(a)
+            , input(in)
+            , output(out)
+            , stamp()
+            , state(WAITING)
+            , msecs(0)
+            , errors()
+            , proc(NULL)
+            , timer()
+        {}
+
+        QString name;
+        QString program;
+        QStringList args;
+        QString input;
+        QString output;
+        QByteArray stamp;
+        State state;
+        qint64 msecs;
+        // standard error of the tool
+        QString errors;
+        QProcess* proc;
+        QElapsedTimer timer;
+    };
+
+    // the last stage of a test, the earlier ones are run too
+    enum Stage { MORPH, TRANSFER, GENERATE };
+
+    // Compilations and tests are run as jobs, started in order of priority.
+    // A compilation takes a slot for each running step, out of
+    // appConfig().toolJobs() less one kept for tests; the one test running at
+    // a time always has that slot, so compiling and testing never wait for
+    // each other.
+    struct Job
+    {
+        enum Kind { COMPILE, TEST };
+
+        Job(int i, Kind k)
+            : id(i)
+            , kind(k)
+            , priority(k == TEST ? 1 : 0)
+            , running(false)
+            , done(0)
+            , total(0)
+            , text()
+            , stage(MORPH)
+        {}
+
+        int id;
+        Kind kind;
+        int priority;
+        bool running;
+        // progress: steps compiled or lines tested
+        int done;
+        int total;
+        // input of tests
+        QString text;
+        Stage stage;
+    };
+
+    bool isTesting() const { return hasJob(Job::TEST); }
+    bool isCompiling() const { return hasJob(Job::COMPILE); }
+    const QList<Job>& jobs() const { return jobs_; }
+    const QList<CompileStep>& compileSteps() const { return steps_; }
 
     const QString& slDict() const { return sldict_; }
     const QString& tlDict() const { return tldict_; }
     const QString& biDict() const { return bidict_; }
     const QString& transferRules() const { return rules_; }
 
+    // the tool of a single stage of a test, and the binaries it loads; the
+    // surface forms have to be removed from the analyses before transfer
+    ToolWorker::Command stageCommand(Stage stage) const;
+    QStringList stageBinaries(Stage stage) const;
+    static QString stripSurfaceForms(const QString& analyses);
+
 public slots:
     void setSlDict(const QString& str) { sldict_ = str; slbin_ = dirOfFile(sldict_) + "/sl.automorph.bin"; }
     void setTlDict(const QString& str) { tldict_ = str; tlbin_ = dirOfFile(tldict_) + "/tl.autogen.bin"; }
     void setBiDict(const QString& str) { bidict_ = str; bibin_ = dirOfFile(bidict_) + "/bilin.autobil.bin"; }
     void setTransferRules(const QString& str) { rules_ = str; rulebin_ = dirOfFile(rules_) + "/transfer.bin"; }
 
-    void compile();
-    void morph(const QString& text);
-    void transfer(const QString& text);
-    void generate(const QString& text);
+    // Both return the id of the job. A compilation requested while another
+    // one is waiting is merged into it.
+    int compile();
+    // Tests the lines of text one by one, their results are emitted in order
+    // as they arrive, followed by testFinished. Only a few lines are given to
+    // the tools at a time. A new test cancels the previous one.
+    int test(const QString& text, Stage last);
+    void cancelTest();
 
 signals:
+    void jobStarted(int id);
+    void jobProgress(int id, int done, int total);
+    void jobFinished(int id, bool successful);
+    void compileStepStarted(int step);
+    void compileStepFinished(int step);
     void compileFinished(bool successful);
-    void morphFinished(const QString& out);
-    void transferFinished(const QString& out);
-    void generateFinished(const QString& out);
+    void testOutput(const QString& out);
+    void testFinished();
+    void testFailed(const QString& error);
 
 private slots:
-    void finished(int retval);
-    void outputReady();
-    void compile2();
-    void compile3();
-    void compile4();
+    void morphAnswered(const QString& out, int run);
+    void stageAnswered(const QString& out, int run);
+    void workerFailed(const QString& error, int run);
+    void compileStepDone(int retval);
+    void compileStepError();
 
 private:
-    enum ProcType { NONE, COMPILE1, COMPILE2, COMPILE3, COMPILE4, MORPH, TRANSFER, GENERATE };
-
     QString dirOfFile(const QString& str) const;
+    ToolWorker* worker(ToolWorker*& w, const char* answered);
+    bool hasJob(Job::Kind kind) const;
+    Job* job(int id);
+    int enqueue(const Job& job);
+    void schedule();
+    int freeSlots(Job::Kind kind) const;
+    void finishJob(int id, bool successful);
+    void progress(int id, int done, int total);
+
+    void startTest(const Job& job);
+    void feedTest();
+    void deliverTest(const QString& out);
+    void startCompile(const Job& job);
+    int stepOf(QObject* proc) const;
+    void startCompileSteps();
+    void finishCompileStep(int index, bool successful);
+    QByteArray stampOf(const CompileStep& s);
+    QByteArray fileHash(const QString& path);
+    static QString stampPath(const CompileStep& s) { return s.output + ".stamp"; }
+    static QString partPath(const CompileStep& s) { return s.output + ".part"; }
 
     QString sldict_, tldict_, bidict_, rules_;
     QString slbin_, tlbin_, bibin_, rulebin_;
-    QProcess* curProc_;
-    ProcType curType_;
+    ToolWorker* morphWorker_;
+    ToolWorker* transferWorker_;
+    // transfer and generation, piped into each other
+    ToolWorker* generateWorker_;
+    // lines of the running test not given to the tools yet
+    QStringList testInput_;
+    Stage testStage_;
+    // answers tagged with an older run are dropped
+    int testRun_;
+    int inFlight_;
+
+    // waiting and running jobs, in order of priority
+    QList<Job> jobs_;
+    int nextJob_;
+    int compileJob_;
+    int testJob_;
+    bool scheduling_;
+
+    QList<CompileStep> steps_;
+    bool compiling_;
+
+    // hashes of the inputs, recomputed when their size or time changes
+    struct FileHash
+    {
+        FileHash() : size(-1), modified(), hash() {}
+
+        qint64 size;
+        QDateTime modified;
+        QByteArray hash;
+    };
+    QHash<QString, FileHash> hashes_;
 };
 
 #endif // TOOLS_H